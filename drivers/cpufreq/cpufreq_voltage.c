@@ -0,0 +1,249 @@
+/*
+ * linux/drivers/cpufreq/cpufreq_voltage.c
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Scales the voltage of a CPU supply along with the CPU frequency, using
+ * the regulator API and a table of the voltage needed at each frequency.
+ * The supply is raised before the frequency goes up and lowered after it
+ * comes down.  When several CPUs share a supply it follows the fastest of
+ * them.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/mutex.h>
+#include <linux/cpufreq.h>
+#include <linux/percpu.h>
+#include <linux/regulator/consumer.h>
+
+#define dprintk(msg...) \
+	cpufreq_debug_printk(CPUFREQ_DEBUG_DRIVER, "cpufreq-voltage", msg)
+
+struct cpufreq_voltage {
+	struct list_head list;
+	cpumask_t cpus;
+	struct regulator *supply;
+	const struct cpufreq_voltage_table *table;
+	int num;
+
+	/* window last requested from the supply, 0 if unknown */
+	int min_uV;
+	int max_uV;
+};
+
+/* protects the list and the state of each entry */
+static DEFINE_MUTEX(cpufreq_voltage_mutex);
+static LIST_HEAD(cpufreq_voltage_list);
+
+/* current frequency of each CPU, 0 if unknown; cpufreq_voltage_mutex */
+static DEFINE_PER_CPU(unsigned int, cpufreq_voltage_cur);
+
+/* Serialises registration of the transition notifier against the count
+ * of users.  Never taken by the notifier itself: unregistering waits for
+ * running callbacks, which may be waiting for cpufreq_voltage_mutex. */
+static DEFINE_MUTEX(cpufreq_voltage_nb_mutex);
+static int cpufreq_voltage_users;
+
+/* The entry covering freq, the last entry covering anything higher */
+static const struct cpufreq_voltage_table *
+cpufreq_voltage_lookup(struct cpufreq_voltage *cv, unsigned int freq)
+{
+	int i;
+
+	for (i = 0; i < cv->num - 1; i++)
+		if (cv->table[i].frequency >= freq)
+			break;
+
+	return &cv->table[i];
+}
+
+/* Request the voltage for freq, unless it is the window we already have.
+ * cpufreq_voltage_mutex held by caller */
+static int cpufreq_voltage_set(struct cpufreq_voltage *cv, unsigned int freq)
+{
+	const struct cpufreq_voltage_table *opp;
+	int ret;
+
+	opp = cpufreq_voltage_lookup(cv, freq);
+	if (opp->min_uV == cv->min_uV && opp->max_uV == cv->max_uV)
+		return 0;
+
+	dprintk("%u kHz needs %d-%d uV\n", freq, opp->min_uV, opp->max_uV);
+
+	ret = regulator_set_voltage(cv->supply, opp->min_uV, opp->max_uV);
+	if (ret != 0) {
+		printk(KERN_ERR "cpufreq: failed to set supply to %d-%d uV "
+		       "for %u kHz: %d\n", opp->min_uV, opp->max_uV, freq, ret);
+		cv->min_uV = 0;
+		cv->max_uV = 0;
+		return ret;
+	}
+
+	cv->min_uV = opp->min_uV;
+	cv->max_uV = opp->max_uV;
+	return 0;
+}
+
+/* The highest known frequency of the online CPUs sharing the supply.
+ * cpufreq_voltage_mutex held by caller */
+static unsigned int cpufreq_voltage_max(struct cpufreq_voltage *cv)
+{
+	unsigned int freq = 0;
+	int cpu;
+
+	for_each_cpu_mask(cpu, cv->cpus)
+		if (cpu_online(cpu))
+			freq = max(freq, per_cpu(cpufreq_voltage_cur, cpu));
+
+	return freq;
+}
+
+static int cpufreq_voltage_transition(struct notifier_block *nb,
+				      unsigned long val, void *data)
+{
+	struct cpufreq_freqs *freqs = data;
+	struct cpufreq_voltage *cv;
+	unsigned int freq;
+
+	mutex_lock(&cpufreq_voltage_mutex);
+
+	if (val != CPUFREQ_PRECHANGE)
+		per_cpu(cpufreq_voltage_cur, freqs->cpu) = freqs->new;
+
+	list_for_each_entry(cv, &cpufreq_voltage_list, list) {
+		if (!cpu_isset(freqs->cpu, cv->cpus))
+			continue;
+
+		/* the supply must cover the fastest CPU sharing it, so a
+		 * CPU slowing down only lowers it if no other CPU is
+		 * still running faster */
+		freq = cpufreq_voltage_max(cv);
+		switch (val) {
+		case CPUFREQ_PRECHANGE:
+			if (freqs->new > freq)
+				cpufreq_voltage_set(cv, freqs->new);
+			break;
+		case CPUFREQ_POSTCHANGE:
+		case CPUFREQ_RESUMECHANGE:
+			if (freq)
+				cpufreq_voltage_set(cv, freq);
+			break;
+		}
+	}
+	mutex_unlock(&cpufreq_voltage_mutex);
+
+	return 0;
+}
+
+static struct notifier_block cpufreq_voltage_nb = {
+	.notifier_call = cpufreq_voltage_transition,
+};
+
+/**
+ * cpufreq_voltage_register - scale a supply with the frequency of CPUs
+ * @cpus: CPUs powered by the supply
+ * @supply: The CPU supply, obtained with regulator_get()
+ * @table: Voltage needed for each frequency, in ascending frequency order
+ * @num: Number of entries in @table
+ *
+ * Each table entry gives the voltage range needed at frequencies up to
+ * its frequency, the last also covering anything higher.  The supply is
+ * set for the highest frequency of any online CPU in @cpus, straight
+ * away if that is known.
+ *
+ * The table must remain valid until cpufreq_voltage_unregister() is
+ * called.  Returns a handle for that or an ERR_PTR() on failure.
+ */
+struct cpufreq_voltage *
+cpufreq_voltage_register(const cpumask_t *cpus, struct regulator *supply,
+			 const struct cpufreq_voltage_table *table, int num)
+{
+	struct cpufreq_voltage *cv;
+	unsigned int freq;
+	int cpu, i, ret;
+
+	if (!supply || !table || num <= 0)
+		return ERR_PTR(-EINVAL);
+	for (i = 0; i < num; i++) {
+		if (table[i].min_uV > table[i].max_uV ||
+		    (i && table[i].frequency <= table[i - 1].frequency)) {
+			printk(KERN_ERR "cpufreq: invalid voltage table entry "
+			       "%d\n", i);
+			return ERR_PTR(-EINVAL);
+		}
+	}
+
+	cv = kzalloc(sizeof(*cv), GFP_KERNEL);
+	if (cv == NULL)
+		return ERR_PTR(-ENOMEM);
+	cv->cpus = *cpus;
+	cv->supply = supply;
+	cv->table = table;
+	cv->num = num;
+
+	mutex_lock(&cpufreq_voltage_nb_mutex);
+
+	if (cpufreq_voltage_users++ == 0) {
+		ret = cpufreq_register_notifier(&cpufreq_voltage_nb,
+						CPUFREQ_TRANSITION_NOTIFIER);
+		if (ret != 0) {
+			cpufreq_voltage_users--;
+			mutex_unlock(&cpufreq_voltage_nb_mutex);
+			kfree(cv);
+			return ERR_PTR(ret);
+		}
+	}
+
+	mutex_lock(&cpufreq_voltage_mutex);
+
+	for_each_cpu_mask(cpu, cv->cpus) {
+		freq = cpufreq_quick_get(cpu);
+		if (freq)
+			per_cpu(cpufreq_voltage_cur, cpu) = freq;
+	}
+
+	freq = cpufreq_voltage_max(cv);
+	if (freq)
+		cpufreq_voltage_set(cv, freq);
+
+	list_add(&cv->list, &cpufreq_voltage_list);
+
+	mutex_unlock(&cpufreq_voltage_mutex);
+
+	mutex_unlock(&cpufreq_voltage_nb_mutex);
+
+	return cv;
+}
+EXPORT_SYMBOL_GPL(cpufreq_voltage_register);
+
+/**
+ * cpufreq_voltage_unregister - stop scaling a supply with CPU frequency
+ * @cv: Handle from cpufreq_voltage_register()
+ *
+ * The last voltage set is left in place.
+ */
+void cpufreq_voltage_unregister(struct cpufreq_voltage *cv)
+{
+	mutex_lock(&cpufreq_voltage_nb_mutex);
+
+	mutex_lock(&cpufreq_voltage_mutex);
+	list_del(&cv->list);
+	mutex_unlock(&cpufreq_voltage_mutex);
+
+	if (--cpufreq_voltage_users == 0)
+		cpufreq_unregister_notifier(&cpufreq_voltage_nb,
+					    CPUFREQ_TRANSITION_NOTIFIER);
+
+	mutex_unlock(&cpufreq_voltage_nb_mutex);
+
+	kfree(cv);
+}
+EXPORT_SYMBOL_GPL(cpufreq_voltage_unregister);
+
+MODULE_DESCRIPTION("CPU supply voltage scaling for cpufreq");
+MODULE_LICENSE("GPL");
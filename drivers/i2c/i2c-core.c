@@ -34,6 +34,8 @@
 #include <linux/completion.h>
 #include <linux/hardirq.h>
 #include <linux/irqflags.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <asm/uaccess.h>
 
 #include "i2c-core.h"
@@ -42,6 +44,10 @@
 static DEFINE_MUTEX(core_lock);
 static DEFINE_IDR(i2c_adapter_idr);
 
+/* runs the queues of asynchronous transfers */
+static struct workqueue_struct *i2c_wq;
+static void i2c_queue_work(struct work_struct *work);
+
 #define is_newstyle_driver(d) ((d)->probe || (d)->remove || (d)->detect)
 
 static int i2c_detect(struct i2c_adapter *adapter, struct i2c_driver *driver);
@@ -438,7 +444,7 @@ static int i2c_do_add_adapter(struct device_driver *d, void *data)
 
 static int i2c_register_adapter(struct i2c_adapter *adap)
 {
-	int res = 0, dummy;
+	int res = 0, dummy, i;
 
 	/* Can't register until after driver model init */
 	if (unlikely(WARN_ON(!i2c_bus_type.p)))
@@ -448,6 +454,13 @@ static int i2c_register_adapter(struct i2c_adapter *adap)
 	mutex_init(&adap->clist_lock);
 	INIT_LIST_HEAD(&adap->clients);
 
+	spin_lock_init(&adap->queue_lock);
+	for (i = 0; i < I2C_PRIO_COUNT; i++)
+		INIT_LIST_HEAD(&adap->queue[i]);
+	INIT_WORK(&adap->queue_work, i2c_queue_work);
+	adap->queue_busy = 0;
+	adap->queue_stopped = 0;
+
 	mutex_lock(&core_lock);
 
 	/* Add the adapter to the driver core.
@@ -611,7 +624,10 @@ static int i2c_do_del_adapter(struct device_driver *d, void *data)
 int i2c_del_adapter(struct i2c_adapter *adap)
 {
 	struct i2c_client *client, *_n;
-	int res = 0;
+	struct i2c_request *req, *_r;
+	LIST_HEAD(pending);
+	unsigned long flags;
+	int res = 0, i;
 
 	mutex_lock(&core_lock);
 
@@ -651,6 +667,22 @@ int i2c_del_adapter(struct i2c_adapter *adap)
 		}
 	}
 
+	/* fail any transfers still queued and wait for the one in
+	 * progress, if any */
+	spin_lock_irqsave(&adap->queue_lock, flags);
+	adap->queue_stopped = 1;
+	for (i = 0; i < I2C_PRIO_COUNT; i++)
+		list_splice_init(&adap->queue[i], pending.prev);
+	spin_unlock_irqrestore(&adap->queue_lock, flags);
+
+	cancel_work_sync(&adap->queue_work);
+
+	list_for_each_entry_safe(req, _r, &pending, queue) {
+		list_del(&req->queue);
+		req->status = -ESHUTDOWN;
+		req->complete(req);
+	}
+
 	/* clean up the sysfs representation */
 	init_completion(&adap->dev_released);
 	device_unregister(&adap->dev);
@@ -964,9 +996,13 @@ static int __init i2c_init(void)
 {
 	int retval;
 
+	i2c_wq = create_workqueue("i2c");
+	if (!i2c_wq)
+		return -ENOMEM;
+
 	retval = bus_register(&i2c_bus_type);
 	if (retval)
-		return retval;
+		goto wq_err;
 	retval = class_register(&i2c_adapter_class);
 	if (retval)
 		goto bus_err;
@@ -979,6 +1015,8 @@ class_err:
 	class_unregister(&i2c_adapter_class);
 bus_err:
 	bus_unregister(&i2c_bus_type);
+wq_err:
+	destroy_workqueue(i2c_wq);
 	return retval;
 }
 
@@ -987,6 +1025,7 @@ static void __exit i2c_exit(void)
 	i2c_del_driver(&dummy_driver);
 	class_unregister(&i2c_adapter_class);
 	bus_unregister(&i2c_bus_type);
+	destroy_workqueue(i2c_wq);
 }
 
 /* We must initialize early, because some subsystems register i2c drivers
@@ -1063,6 +1102,154 @@ int i2c_transfer(struct i2c_adapter * adap, struct i2c_msg *msgs, int num)
 }
 EXPORT_SYMBOL(i2c_transfer);
 
+/* Most queued writes combined into a single transfer */
+#define I2C_MERGE_MAX	8
+
+/* A request which can be combined with others: a single write, to the
+ * same slave as the first request in the combined transfer */
+static int i2c_request_mergeable(struct i2c_request *req,
+				 struct i2c_request *first)
+{
+	if (req->num != 1 || (req->msgs[0].flags & I2C_M_RD))
+		return 0;
+
+	return req->msgs[0].addr == first->msgs[0].addr &&
+		req->msgs[0].flags == first->msgs[0].flags;
+}
+
+/* Take the next transfer off the queues, along with any writes queued
+ * directly behind it which can go in the same transfer.  Returns the
+ * number of requests taken.  queue_lock held by caller. */
+static int i2c_queue_next(struct i2c_adapter *adap,
+			  struct i2c_request **reqs)
+{
+	struct list_head *queue = NULL;
+	struct i2c_request *req;
+	int i, n;
+
+	for (i = 0; i < I2C_PRIO_COUNT; i++) {
+		if (!list_empty(&adap->queue[i])) {
+			queue = &adap->queue[i];
+			break;
+		}
+	}
+	if (!queue)
+		return 0;
+
+	reqs[0] = list_first_entry(queue, struct i2c_request, queue);
+	list_del(&reqs[0]->queue);
+	n = 1;
+
+	/* combining messages relies on repeated starts */
+	if (!i2c_check_functionality(adap, I2C_FUNC_I2C) ||
+	    !i2c_request_mergeable(reqs[0], reqs[0]))
+		return n;
+
+	while (n < I2C_MERGE_MAX && !list_empty(queue)) {
+		req = list_first_entry(queue, struct i2c_request, queue);
+		if (!i2c_request_mergeable(req, reqs[0]))
+			break;
+		list_del(&req->queue);
+		reqs[n++] = req;
+	}
+
+	return n;
+}
+
+static void i2c_queue_work(struct work_struct *work)
+{
+	struct i2c_adapter *adap = container_of(work, struct i2c_adapter,
+						queue_work);
+	struct i2c_request *reqs[I2C_MERGE_MAX];
+	struct i2c_msg msgs[I2C_MERGE_MAX];
+	int i, n, ret;
+
+	/* The work can be queued again on another CPU while it runs.  Only
+	 * one instance runs the queues so transfers stay in order; it
+	 * picks up anything queued before it finishes. */
+	spin_lock_irq(&adap->queue_lock);
+	if (adap->queue_busy) {
+		spin_unlock_irq(&adap->queue_lock);
+		return;
+	}
+	adap->queue_busy = 1;
+	spin_unlock_irq(&adap->queue_lock);
+
+	for (;;) {
+		spin_lock_irq(&adap->queue_lock);
+		n = i2c_queue_next(adap, reqs);
+		if (!n)
+			adap->queue_busy = 0;
+		spin_unlock_irq(&adap->queue_lock);
+		if (!n)
+			break;
+
+		if (n == 1) {
+			reqs[0]->status = i2c_transfer(adap, reqs[0]->msgs,
+						       reqs[0]->num);
+			reqs[0]->complete(reqs[0]);
+			continue;
+		}
+
+		for (i = 0; i < n; i++)
+			msgs[i] = reqs[i]->msgs[0];
+
+		ret = i2c_transfer(adap, msgs, n);
+
+		/* each request gets the status of its own message */
+		for (i = 0; i < n; i++) {
+			if (ret < 0)
+				reqs[i]->status = ret;
+			else if (i < ret)
+				reqs[i]->status = 1;
+			else
+				reqs[i]->status = -EIO;
+			reqs[i]->complete(reqs[i]);
+		}
+	}
+}
+
+/**
+ * i2c_transfer_async - queue a single or combined I2C message
+ * @adap: Handle to I2C bus
+ * @req: The transfer, with its messages, priority and completion
+ *	callback filled in
+ * Context: any
+ *
+ * Queues the transfer behind any others in the same priority class on
+ * the adapter and returns without waiting.  @req->complete() is called
+ * from process context once it has been done, with @req->status set as
+ * the return value of i2c_transfer() would be.  Writes of a single
+ * message to the same slave which are queued next to each other may be
+ * combined into one transfer, separated by repeated starts, on adapters
+ * which support plain I2C.
+ *
+ * Returns zero if the transfer was queued, else a negative errno.
+ */
+int i2c_transfer_async(struct i2c_adapter *adap, struct i2c_request *req)
+{
+	unsigned long flags;
+	int ret = 0;
+
+	if (!adap->algo->master_xfer)
+		return -EOPNOTSUPP;
+	if (req->num <= 0 || !req->complete ||
+	    req->prio < 0 || req->prio >= I2C_PRIO_COUNT)
+		return -EINVAL;
+
+	spin_lock_irqsave(&adap->queue_lock, flags);
+	if (adap->queue_stopped) {
+		ret = -ESHUTDOWN;
+	} else {
+		list_add_tail(&req->queue, &adap->queue[req->prio]);
+		queue_work(i2c_wq, &adap->queue_work);
+	}
+	spin_unlock_irqrestore(&adap->queue_lock, flags);
+
+	return ret;
+}
+EXPORT_SYMBOL(i2c_transfer_async);
+
 /**
  * i2c_master_send - issue a single I2C message in master transmit mode
  * @client: Handle to slave device
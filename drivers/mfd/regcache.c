@@ -0,0 +1,546 @@
+/*
+ * regcache.c  --  Register cache for MFD cores
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Keeps a copy of the registers of a device in memory together with a
+ * record of which registers need writing back to the device, so that
+ * MFD cores only need to implement their bus access and any per-bit
+ * masking.  Writes can be held in the cache, either for a batch or while
+ * the device is unavailable, and written back later with each run of
+ * adjacent registers going out in a single transfer.
+ *
+ * No locking is done here, the caller must serialise all access to a
+ * cache, normally with the lock it already uses for device I/O.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/err.h>
+#include <linux/bitops.h>
+#include <linux/rbtree.h>
+#include <linux/slab.h>
+#include <linux/mfd/regcache.h>
+
+struct regcache_ops {
+	int (*init)(struct regcache *rc);
+	void (*exit)(struct regcache *rc);
+	/* returns -ENOENT if the register has not been stored */
+	int (*read)(struct regcache *rc, unsigned int reg, u16 *val);
+	int (*write)(struct regcache *rc, unsigned int reg, u16 val);
+};
+
+struct regcache {
+	struct regcache_config config;
+	const struct regcache_ops *ops;
+	void *priv;
+
+	unsigned long *dirty;
+
+	/* holds one block for regcache_sync() */
+	u16 *sync_buf;
+	int sync_max;
+};
+
+static u16 regcache_default(struct regcache *rc, unsigned int reg)
+{
+	if (rc->config.defaults)
+		return rc->config.defaults[reg];
+	return 0;
+}
+
+/*
+ * Flat cache: one array entry for every register.
+ */
+static int regcache_flat_init(struct regcache *rc)
+{
+	u16 *cache;
+	int i;
+
+	cache = kcalloc(rc->config.max_register + 1, sizeof(u16), GFP_KERNEL);
+	if (cache == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i <= rc->config.max_register; i++)
+		cache[i] = regcache_default(rc, i);
+
+	rc->priv = cache;
+	return 0;
+}
+
+static void regcache_flat_exit(struct regcache *rc)
+{
+	kfree(rc->priv);
+}
+
+static int regcache_flat_read(struct regcache *rc, unsigned int reg, u16 *val)
+{
+	u16 *cache = rc->priv;
+
+	*val = cache[reg];
+	return 0;
+}
+
+static int regcache_flat_write(struct regcache *rc, unsigned int reg, u16 val)
+{
+	u16 *cache = rc->priv;
+
+	cache[reg] = val;
+	return 0;
+}
+
+static const struct regcache_ops regcache_flat_ops = {
+	.init = regcache_flat_init,
+	.exit = regcache_flat_exit,
+	.read = regcache_flat_read,
+	.write = regcache_flat_write,
+};
+
+/*
+ * rbtree cache: blocks of adjacent registers indexed by their first
+ * register.  A register stored next to an existing block extends it so
+ * registers written together share a block.
+ */
+struct regcache_rbtree_node {
+	struct rb_node node;
+	unsigned int base;
+	unsigned int len;
+	u16 *vals;
+};
+
+struct regcache_rbtree {
+	struct rb_root root;
+	struct regcache_rbtree_node *last;	/* last block used */
+};
+
+static inline int regcache_rbtree_contains(struct regcache_rbtree_node *n,
+					   unsigned int reg)
+{
+	return reg >= n->base && reg < n->base + n->len;
+}
+
+static struct regcache_rbtree_node *
+regcache_rbtree_lookup(struct regcache_rbtree *tree, unsigned int reg)
+{
+	struct rb_node *node = tree->root.rb_node;
+	struct regcache_rbtree_node *n;
+
+	if (tree->last && regcache_rbtree_contains(tree->last, reg))
+		return tree->last;
+
+	while (node) {
+		n = rb_entry(node, struct regcache_rbtree_node, node);
+		if (reg < n->base)
+			node = node->rb_left;
+		else if (reg >= n->base + n->len)
+			node = node->rb_right;
+		else {
+			tree->last = n;
+			return n;
+		}
+	}
+
+	return NULL;
+}
+
+static int regcache_rbtree_init(struct regcache *rc)
+{
+	struct regcache_rbtree *tree;
+
+	tree = kzalloc(sizeof(*tree), GFP_KERNEL);
+	if (tree == NULL)
+		return -ENOMEM;
+
+	tree->root = RB_ROOT;
+	rc->priv = tree;
+	return 0;
+}
+
+static void regcache_rbtree_exit(struct regcache *rc)
+{
+	struct regcache_rbtree *tree = rc->priv;
+	struct regcache_rbtree_node *n;
+	struct rb_node *node;
+
+	while ((node = rb_first(&tree->root)) != NULL) {
+		n = rb_entry(node, struct regcache_rbtree_node, node);
+		rb_erase(node, &tree->root);
+		kfree(n->vals);
+		kfree(n);
+	}
+	kfree(tree);
+}
+
+static int regcache_rbtree_read(struct regcache *rc, unsigned int reg,
+				u16 *val)
+{
+	struct regcache_rbtree_node *n;
+
+	n = regcache_rbtree_lookup(rc->priv, reg);
+	if (n == NULL)
+		return -ENOENT;
+
+	*val = n->vals[reg - n->base];
+	return 0;
+}
+
+/* Grow a block by one register at either end */
+static int regcache_rbtree_extend(struct regcache_rbtree_node *n,
+				  unsigned int reg, u16 val)
+{
+	u16 *vals;
+
+	vals = krealloc(n->vals, (n->len + 1) * sizeof(u16), GFP_KERNEL);
+	if (vals == NULL)
+		return -ENOMEM;
+
+	if (reg < n->base) {
+		memmove(&vals[1], &vals[0], n->len * sizeof(u16));
+		vals[0] = val;
+		n->base = reg;
+	} else {
+		vals[n->len] = val;
+	}
+
+	n->vals = vals;
+	n->len++;
+	return 0;
+}
+
+static int regcache_rbtree_write(struct regcache *rc, unsigned int reg,
+				 u16 val)
+{
+	struct regcache_rbtree *tree = rc->priv;
+	struct regcache_rbtree_node *n, *adjacent = NULL;
+	struct rb_node **new = &tree->root.rb_node, *parent = NULL;
+
+	n = regcache_rbtree_lookup(tree, reg);
+	if (n) {
+		n->vals[reg - n->base] = val;
+		return 0;
+	}
+
+	/* look for a block to extend while finding where a new one goes */
+	while (*new) {
+		n = rb_entry(*new, struct regcache_rbtree_node, node);
+		parent = *new;
+		if (reg < n->base) {
+			if (reg + 1 == n->base && !adjacent)
+				adjacent = n;
+			new = &(*new)->rb_left;
+		} else {
+			if (reg == n->base + n->len)
+				adjacent = n;
+			new = &(*new)->rb_right;
+		}
+	}
+
+	/* extending a block doesn't change its place in the tree since
+	 * blocks never overlap */
+	if (adjacent) {
+		tree->last = adjacent;
+		return regcache_rbtree_extend(adjacent, reg, val);
+	}
+
+	n = kzalloc(sizeof(*n), GFP_KERNEL);
+	if (n == NULL)
+		return -ENOMEM;
+	n->vals = kmalloc(sizeof(u16), GFP_KERNEL);
+	if (n->vals == NULL) {
+		kfree(n);
+		return -ENOMEM;
+	}
+	n->base = reg;
+	n->len = 1;
+	n->vals[0] = val;
+
+	rb_link_node(&n->node, parent, new);
+	rb_insert_color(&n->node, &tree->root);
+	tree->last = n;
+
+	return 0;
+}
+
+static const struct regcache_ops regcache_rbtree_ops = {
+	.init = regcache_rbtree_init,
+	.exit = regcache_rbtree_exit,
+	.read = regcache_rbtree_read,
+	.write = regcache_rbtree_write,
+};
+
+/**
+ * regcache_init - Create a register cache
+ *
+ * @config: Description of the register map, copied by the cache.
+ *
+ * Every register initially holds its default.  Returns the cache or an
+ * ERR_PTR() on failure.
+ */
+struct regcache *regcache_init(const struct regcache_config *config)
+{
+	struct regcache *rc;
+	int ret;
+
+	if (config->write == NULL)
+		return ERR_PTR(-EINVAL);
+
+	rc = kzalloc(sizeof(*rc), GFP_KERNEL);
+	if (rc == NULL)
+		return ERR_PTR(-ENOMEM);
+	rc->config = *config;
+
+	switch (config->type) {
+	case REGCACHE_FLAT:
+		rc->ops = &regcache_flat_ops;
+		break;
+	case REGCACHE_RBTREE:
+		rc->ops = &regcache_rbtree_ops;
+		break;
+	default:
+		ret = -EINVAL;
+		goto err;
+	}
+
+	rc->dirty = kcalloc(BITS_TO_LONGS(config->max_register + 1),
+			    sizeof(unsigned long), GFP_KERNEL);
+	if (rc->dirty == NULL) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	rc->sync_max = config->max_block;
+	if (rc->sync_max <= 0 || rc->sync_max > config->max_register + 1)
+		rc->sync_max = config->max_register + 1;
+	rc->sync_buf = kmalloc(rc->sync_max * sizeof(u16), GFP_KERNEL);
+	if (rc->sync_buf == NULL) {
+		ret = -ENOMEM;
+		goto err_dirty;
+	}
+
+	ret = rc->ops->init(rc);
+	if (ret != 0)
+		goto err_buf;
+
+	return rc;
+
+err_buf:
+	kfree(rc->sync_buf);
+err_dirty:
+	kfree(rc->dirty);
+err:
+	kfree(rc);
+	return ERR_PTR(ret);
+}
+EXPORT_SYMBOL_GPL(regcache_init);
+
+/**
+ * regcache_exit - Free a register cache
+ *
+ * @rc: Cache to free.  Dirty registers are discarded.
+ */
+void regcache_exit(struct regcache *rc)
+{
+	if (rc == NULL)
+		return;
+
+	rc->ops->exit(rc);
+	kfree(rc->sync_buf);
+	kfree(rc->dirty);
+	kfree(rc);
+}
+EXPORT_SYMBOL_GPL(regcache_exit);
+
+/**
+ * regcache_read - Read a register from the cache
+ *
+ * @rc:  Cache to read.
+ * @reg: Register to read.
+ *
+ * Registers which have never been stored read as their default.
+ */
+u16 regcache_read(struct regcache *rc, unsigned int reg)
+{
+	u16 val;
+
+	BUG_ON(reg > rc->config.max_register);
+
+	if (rc->ops->read(rc, reg, &val) != 0)
+		val = regcache_default(rc, reg);
+	return val;
+}
+EXPORT_SYMBOL_GPL(regcache_read);
+
+/**
+ * regcache_write - Store a register value in the cache
+ *
+ * @rc:  Cache to update.
+ * @reg: Register to store.
+ * @val: New value.
+ *
+ * The caller is expected to write the value to the device as well, so
+ * the register is marked clean.
+ */
+int regcache_write(struct regcache *rc, unsigned int reg, u16 val)
+{
+	int ret;
+
+	BUG_ON(reg > rc->config.max_register);
+
+	ret = rc->ops->write(rc, reg, val);
+	if (ret != 0)
+		return ret;
+
+	regcache_set_dirty(rc, reg, 0);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(regcache_write);
+
+/**
+ * regcache_volatile - Test if a register is volatile
+ *
+ * @rc:  Cache for the device.
+ * @reg: Register to test.
+ */
+int regcache_volatile(struct regcache *rc, unsigned int reg)
+{
+	const struct regcache_range *r = rc->config.volatile_ranges;
+	int i;
+
+	for (i = 0; i < rc->config.num_volatile_ranges; i++)
+		if (reg >= r[i].start && reg <= r[i].end)
+			return 1;
+
+	if (rc->config.volatile_reg)
+		return rc->config.volatile_reg(rc->config.data, reg);
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(regcache_volatile);
+
+/**
+ * regcache_set_dirty - Mark a register as needing to be written back
+ *
+ * @rc:    Cache to update.
+ * @reg:   Register to mark.
+ * @dirty: Non-zero if the next regcache_sync() should write the register.
+ */
+void regcache_set_dirty(struct regcache *rc, unsigned int reg, int dirty)
+{
+	if (dirty)
+		set_bit(reg, rc->dirty);
+	else
+		clear_bit(reg, rc->dirty);
+}
+EXPORT_SYMBOL_GPL(regcache_set_dirty);
+
+/**
+ * regcache_mark_dirty - Mark the cache as needing to be restored
+ *
+ * @rc: Cache to update.
+ *
+ * Used after the device has lost its register contents, for example
+ * over a suspend with its supplies off.  Every register which is not
+ * volatile and does not hold its default is marked dirty so that the
+ * next regcache_sync() restores it.
+ */
+void regcache_mark_dirty(struct regcache *rc)
+{
+	unsigned int reg;
+
+	for (reg = 0; reg <= rc->config.max_register; reg++) {
+		if (regcache_volatile(rc, reg))
+			continue;
+		if (rc->config.defaults &&
+		    regcache_read(rc, reg) == regcache_default(rc, reg))
+			continue;
+		set_bit(reg, rc->dirty);
+	}
+}
+EXPORT_SYMBOL_GPL(regcache_mark_dirty);
+
+/* Can a register be written back from the cache at the moment? */
+static int regcache_writable(struct regcache *rc, unsigned int reg)
+{
+	if (regcache_volatile(rc, reg))
+		return 0;
+	if (rc->config.writable_reg)
+		return rc->config.writable_reg(rc->config.data, reg);
+	return 1;
+}
+
+/**
+ * regcache_sync - Write dirty registers back to the device
+ *
+ * @rc: Cache to write back.
+ *
+ * Each run of adjacent dirty registers is written in one transfer,
+ * also taking in single clean registers between two runs where they
+ * can safely be written.  Volatile registers are never written.
+ * Dirty registers which can't be written at the moment, e.g. because
+ * they have been locked since, are left dirty and -EPERM is returned.
+ * Returns zero or the first error, registers which failed to write stay
+ * dirty for the next sync.
+ */
+int regcache_sync(struct regcache *rc)
+{
+	unsigned int max = rc->config.max_register;
+	unsigned int reg, end, i;
+	int ret = 0, err;
+
+	reg = find_first_bit(rc->dirty, max + 1);
+	while (reg <= max) {
+		if (regcache_volatile(rc, reg)) {
+			clear_bit(reg, rc->dirty);
+			reg = find_next_bit(rc->dirty, max + 1, reg + 1);
+			continue;
+		}
+
+		if (!regcache_writable(rc, reg)) {
+			printk(KERN_ERR "%s: R%d can't be written\n",
+			       __func__, reg);
+			if (!ret)
+				ret = -EPERM;
+			reg = find_next_bit(rc->dirty, max + 1, reg + 1);
+			continue;
+		}
+
+		end = reg + 1;
+		while (end <= max && end - reg < rc->sync_max) {
+			if (test_bit(end, rc->dirty) &&
+			    regcache_writable(rc, end))
+				end++;
+			else if (end < max && end + 1 - reg < rc->sync_max &&
+				 test_bit(end + 1, rc->dirty) &&
+				 regcache_writable(rc, end + 1) &&
+				 regcache_writable(rc, end))
+				end += 2;
+			else
+				break;
+		}
+
+		for (i = reg; i < end; i++)
+			rc->sync_buf[i - reg] = regcache_read(rc, i);
+
+		err = rc->config.write(rc->config.data, reg, end - reg,
+				       rc->sync_buf);
+		if (err) {
+			printk(KERN_ERR "%s: write of R%d-R%d failed: %d\n",
+			       __func__, reg, end - 1, err);
+			if (!ret)
+				ret = err;
+		} else {
+			for (i = reg; i < end; i++)
+				clear_bit(i, rc->dirty);
+		}
+
+		reg = find_next_bit(rc->dirty, max + 1, end);
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(regcache_sync);
+
+MODULE_DESCRIPTION("Register cache for MFD cores");
+MODULE_LICENSE("GPL");
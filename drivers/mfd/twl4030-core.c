@@ -350,6 +350,85 @@ int twl4030_i2c_read_u8(u8 mod_no, u8 *value, u8 reg)
 }
 EXPORT_SYMBOL(twl4030_i2c_read_u8);
 
+/**
+ * twl4030_i2c_xfer - Reads and writes register blocks in several modules
+ * @xfer: the blocks to transfer
+ * @num: number of blocks, at most TWL4030_XFER_MAX
+ *
+ * The blocks on each slave are issued as one i2c transfer, so a caller
+ * touching several modules pays for one bus transaction per slave rather
+ * than one per block.  Slaves are handled in turn and the first error
+ * stops the rest.
+ *
+ * Returns result of operation - 0 is success
+ */
+int twl4030_i2c_xfer(struct twl4030_xfer *xfer, unsigned num)
+{
+	struct i2c_msg msgs[2 * TWL4030_XFER_MAX];
+	u8 addr[TWL4030_XFER_MAX];
+	struct twl4030_client *twl;
+	struct twl4030mapping *map;
+	int ret;
+	int sid;
+	int i, n;
+
+	if (unlikely(num > TWL4030_XFER_MAX))
+		return -EINVAL;
+	for (i = 0; i < num; i++) {
+		if (unlikely(xfer[i].mod_no > TWL4030_MODULE_LAST)) {
+			pr_err("%s: invalid module number %d\n", DRIVER_NAME,
+					xfer[i].mod_no);
+			return -EPERM;
+		}
+	}
+	if (unlikely(!inuse)) {
+		pr_err("%s: clients are not initialized\n", DRIVER_NAME);
+		return -EPERM;
+	}
+
+	for (sid = 0; sid < TWL4030_NUM_SLAVES; sid++) {
+		twl = &twl4030_modules[sid];
+
+		n = 0;
+		for (i = 0; i < num; i++) {
+			map = &twl4030_map[xfer[i].mod_no];
+			if (map->sid != sid)
+				continue;
+
+			if (xfer[i].write) {
+				/* register address goes in the first byte */
+				xfer[i].value[0] = map->base + xfer[i].reg;
+				msgs[n].addr = twl->address;
+				msgs[n].flags = 0;
+				msgs[n].len = xfer[i].num_bytes + 1;
+				msgs[n].buf = xfer[i].value;
+				n++;
+			} else {
+				addr[i] = map->base + xfer[i].reg;
+				msgs[n].addr = twl->address;
+				msgs[n].flags = 0;
+				msgs[n].len = 1;
+				msgs[n].buf = &addr[i];
+				n++;
+				msgs[n].addr = twl->address;
+				msgs[n].flags = I2C_M_RD;
+				msgs[n].len = xfer[i].num_bytes;
+				msgs[n].buf = xfer[i].value;
+				n++;
+			}
+		}
+		if (!n)
+			continue;
+
+		ret = i2c_transfer(twl->client->adapter, msgs, n);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+EXPORT_SYMBOL(twl4030_i2c_xfer);
+
 /*----------------------------------------------------------------------*/
 
 /*
@@ -31,6 +31,9 @@
 #include <linux/interrupt.h>
 #include <linux/irq.h>
 #include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 
 #include <linux/i2c/twl4030.h>
 
@@ -174,6 +177,41 @@ static unsigned twl4030_irq_base;
 
 static struct completion irq_event;
 
+/* when the PIH interrupt was last taken, set in hardirq context */
+static ktime_t irq_stamp;
+
+/*
+ * Latency from the PMIC raising its interrupt to the handler for each
+ * PIH module being called, covering the thread wakeup and the I2C reads
+ * of the PIH and SIH status.  Shown in debugfs as twl4030-irq.
+ */
+struct irq_latency {
+	unsigned long	count;
+	u32		last_us;
+	u32		max_us;
+	u64		total_us;
+};
+
+static DEFINE_SPINLOCK(irq_latency_lock);
+static struct irq_latency irq_latency[ARRAY_SIZE(sih_modules)];
+
+static void twl4030_irq_latency(int module)
+{
+	struct irq_latency *lat = &irq_latency[module];
+	s64 us = ktime_to_us(ktime_sub(ktime_get(), irq_stamp));
+	u32 val = min_t(s64, us, ~0U);
+
+	spin_lock(&irq_latency_lock);
+	lat->count++;
+	lat->last_us = val;
+	if (val > lat->max_us)
+		lat->max_us = val;
+	lat->total_us += val;
+	spin_unlock(&irq_latency_lock);
+}
+
+static void twl4030_sih_read_isrs(u8 pih_isr);
+
 /*
  * This thread processes interrupts reported by the Primary Interrupt Handler.
  */
@@ -189,6 +227,7 @@ static int twl4030_irq_thread(void *data)
 	while (!kthread_should_stop()) {
 		int ret;
 		int module_irq;
+		int module;
 		u8 pih_isr;
 
 		/* Wait for IRQ, then read PIH irq status (also blocking) */
@@ -209,11 +248,16 @@ static int twl4030_irq_thread(void *data)
 			continue;
 		}
 
+		/* fetch the status of every SIH module flagged in one go,
+		 * rather than a read from each handler
+		 */
+		twl4030_sih_read_isrs(pih_isr);
+
 		/* these handlers deal with the relevant SIH irq status */
 		local_irq_disable();
-		for (module_irq = twl4030_irq_base;
+		for (module_irq = twl4030_irq_base, module = 0;
 				pih_isr;
-				pih_isr >>= 1, module_irq++) {
+				pih_isr >>= 1, module_irq++, module++) {
 			if (pih_isr & 0x1) {
 				irq_desc_t *d = irq_desc + module_irq;
 
@@ -223,8 +267,11 @@ static int twl4030_irq_thread(void *data)
 				if (d->status & IRQ_DISABLED)
 					note_interrupt(module_irq, d,
 							IRQ_NONE);
-				else
+				else {
+					if (module < ARRAY_SIZE(irq_latency))
+						twl4030_irq_latency(module);
 					d->handle_irq(module_irq, d);
+				}
 			}
 		}
 		local_irq_enable();
@@ -248,6 +295,7 @@ static void handle_twl4030_pih(unsigned int irq, irq_desc_t *desc)
 {
 	/* Acknowledge, clear *AND* mask the interrupt... */
 	desc->chip->ack(irq);
+	irq_stamp = ktime_get();
 	complete(&irq_event);
 }
 
@@ -378,82 +426,79 @@ struct sih_agent {
 
 	u32			imr;
 	bool			imr_change_pending;
-	struct work_struct	mask_work;
 
 	u32			edge_change;
-	struct work_struct	edge_work;
-};
 
-static void twl4030_sih_do_mask(struct work_struct *work)
-{
-	struct sih_agent	*agent;
-	const struct sih	*sih;
+	/* status read by the irq thread for handle_twl4030_sih() */
 	union {
 		u8	bytes[4];
 		u32	word;
-	}			imr;
-	int			status;
+	}			isr;
+	int			isr_status;
 
-	agent = container_of(work, struct sih_agent, mask_work);
+	/* scratch for twl4030_sih_sync(), first byte for the address */
+	union {
+		u8	bytes[4];
+		u32	word;
+	}			imr_buf;
+	u8			edr_buf[6];
+};
 
-	/* see what work we have */
-	spin_lock_irq(&sih_agent_lock);
-	if (agent->imr_change_pending) {
-		sih = agent->sih;
-		/* byte[0] gets overwritten as we write ... */
-		imr.word = cpu_to_le32(agent->imr << 8);
-		agent->imr_change_pending = false;
-	} else
-		sih = NULL;
-	spin_unlock_irq(&sih_agent_lock);
-	if (!sih)
-		return;
+/* indexed like sih_modules[], NULL until twl4030_sih_setup() */
+static struct sih_agent *sih_agents[ARRAY_SIZE(sih_modules)];
 
-	/* write the whole mask ... simpler than subsetting it */
-	status = twl4030_i2c_write(sih->module, imr.bytes,
-			sih->mask[irq_line].imr_offset, sih->bytes_ixr);
-	if (status)
-		pr_err("twl4030: %s, %s --> %d\n", __func__,
-				"write", status);
-}
+/* one work item writes back the changes pending for all agents */
+static struct work_struct sih_sync_work;
 
-static void twl4030_sih_do_edge(struct work_struct *work)
+/*
+ * Read the ISR of every set up SIH module flagged in pih_isr.  The
+ * modules share only three i2c slaves, so this is at most three
+ * transfers however many modules are raising interrupts.  Reading
+ * acks the IRQs, using clear-on-read mode.
+ */
+static void twl4030_sih_read_isrs(u8 pih_isr)
 {
+	struct twl4030_xfer	xfer[ARRAY_SIZE(sih_modules)];
 	struct sih_agent	*agent;
 	const struct sih	*sih;
-	u8			bytes[6];
-	u32			edge_change;
+	int			i, n = 0;
 	int			status;
 
-	agent = container_of(work, struct sih_agent, edge_work);
+	for (i = 0; i < ARRAY_SIZE(sih_modules); i++) {
+		agent = sih_agents[i];
+		if (!agent || !(pih_isr & BIT(i)))
+			continue;
+		sih = agent->sih;
 
-	/* see what work we have */
-	spin_lock_irq(&sih_agent_lock);
-	edge_change = agent->edge_change;
-	agent->edge_change = 0;;
-	sih = edge_change ? agent->sih : NULL;
-	spin_unlock_irq(&sih_agent_lock);
-	if (!sih)
+		/* FIXME need retry-on-error ... */
+		agent->isr.word = 0;
+		xfer[n].mod_no = sih->module;
+		xfer[n].reg = sih->mask[irq_line].isr_offset;
+		xfer[n].num_bytes = sih->bytes_ixr;
+		xfer[n].write = false;
+		xfer[n].value = agent->isr.bytes;
+		n++;
+	}
+	if (!n)
 		return;
 
-	/* Read, reserving first byte for write scratch.  Yes, this
-	 * could be cached for some speedup ... but be careful about
-	 * any processor on the other IRQ line, EDR registers are
-	 * shared.
-	 */
-	status = twl4030_i2c_read(sih->module, bytes + 1,
-			sih->edr_offset, sih->bytes_edr);
-	if (status) {
-		pr_err("twl4030: %s, %s --> %d\n", __func__,
-				"read", status);
-		return;
+	status = twl4030_i2c_xfer(xfer, n);
+
+	for (i = 0; i < ARRAY_SIZE(sih_modules); i++) {
+		agent = sih_agents[i];
+		if (agent && (pih_isr & BIT(i)))
+			agent->isr_status = status;
 	}
+}
 
-	/* Modify only the bits we know must change */
+/* Fold the trigger of each IRQ in edge_change into an EDR image */
+static void sih_update_edr(struct sih_agent *agent, u8 *bytes,
+		u32 edge_change)
+{
 	while (edge_change) {
 		int		i = fls(edge_change) - 1;
 		struct irq_desc	*d = irq_desc + i + agent->irq_base;
-		int		byte = 1 + (i >> 2);
+		int		byte = i >> 2;
 		int		off = (i & 0x3) * 2;
 
 		bytes[byte] &= ~(0x03 << off);
@@ -467,10 +512,109 @@ static void twl4030_sih_do_edge(struct work_struct *work)
 
 		edge_change &= ~BIT(i);
 	}
+}
+
+/*
+ * Write back the mask and trigger changes made since the last run for
+ * every agent.  Changes arriving while we wait for the bus are picked
+ * up together, and all the registers go out in one burst per slave:
+ * the EDRs are read in one burst, then written along with the IMRs.
+ */
+static void twl4030_sih_sync(struct work_struct *work)
+{
+	struct twl4030_xfer	xfer[2 * ARRAY_SIZE(sih_modules)];
+	u32			edge_change[ARRAY_SIZE(sih_modules)];
+	bool			imr_change[ARRAY_SIZE(sih_modules)];
+	struct sih_agent	*agent;
+	const struct sih	*sih;
+	int			i, n;
+	int			status;
+
+	/* see what work we have */
+	spin_lock_irq(&sih_agent_lock);
+	for (i = 0; i < ARRAY_SIZE(sih_modules); i++) {
+		agent = sih_agents[i];
+		edge_change[i] = 0;
+		imr_change[i] = false;
+		if (!agent)
+			continue;
+
+		edge_change[i] = agent->edge_change;
+		agent->edge_change = 0;
 
-	/* Write */
-	status = twl4030_i2c_write(sih->module, bytes,
-			sih->edr_offset, sih->bytes_edr);
+		if (agent->imr_change_pending) {
+			/* byte[0] gets overwritten as we write ... */
+			agent->imr_buf.word = cpu_to_le32(agent->imr << 8);
+			agent->imr_change_pending = false;
+			imr_change[i] = true;
+		}
+	}
+	spin_unlock_irq(&sih_agent_lock);
+
+	/* Read, reserving first byte for write scratch.  Yes, this
+	 * could be cached for some speedup ... but be careful about
+	 * any processor on the other IRQ line, EDR registers are
+	 * shared.
+	 */
+	n = 0;
+	for (i = 0; i < ARRAY_SIZE(sih_modules); i++) {
+		if (!edge_change[i])
+			continue;
+		sih = sih_agents[i]->sih;
+
+		xfer[n].mod_no = sih->module;
+		xfer[n].reg = sih->edr_offset;
+		xfer[n].num_bytes = sih->bytes_edr;
+		xfer[n].write = false;
+		xfer[n].value = sih_agents[i]->edr_buf + 1;
+		n++;
+	}
+	if (n) {
+		status = twl4030_i2c_xfer(xfer, n);
+		if (status) {
+			pr_err("twl4030: %s, %s --> %d\n", __func__,
+					"read", status);
+			memset(edge_change, 0, sizeof edge_change);
+		}
+	}
+
+	/* Modify only the bits we know must change, then write the
+	 * triggers ahead of the masks so nothing is unmasked with a
+	 * stale trigger.  The whole mask is simpler than subsetting it.
+	 */
+	n = 0;
+	for (i = 0; i < ARRAY_SIZE(sih_modules); i++) {
+		if (!edge_change[i])
+			continue;
+		agent = sih_agents[i];
+		sih = agent->sih;
+
+		sih_update_edr(agent, agent->edr_buf + 1, edge_change[i]);
+
+		xfer[n].mod_no = sih->module;
+		xfer[n].reg = sih->edr_offset;
+		xfer[n].num_bytes = sih->bytes_edr;
+		xfer[n].write = true;
+		xfer[n].value = agent->edr_buf;
+		n++;
+	}
+	for (i = 0; i < ARRAY_SIZE(sih_modules); i++) {
+		if (!imr_change[i])
+			continue;
+		agent = sih_agents[i];
+		sih = agent->sih;
+
+		xfer[n].mod_no = sih->module;
+		xfer[n].reg = sih->mask[irq_line].imr_offset;
+		xfer[n].num_bytes = sih->bytes_ixr;
+		xfer[n].write = true;
+		xfer[n].value = agent->imr_buf.bytes;
+		n++;
+	}
+	if (!n)
+		return;
+
+	status = twl4030_i2c_xfer(xfer, n);
 	if (status)
 		pr_err("twl4030: %s, %s --> %d\n", __func__,
 				"write", status);
@@ -493,7 +637,7 @@ static void twl4030_sih_mask(unsigned irq)
 	spin_lock_irqsave(&sih_agent_lock, flags);
 	sih->imr |= BIT(irq - sih->irq_base);
 	sih->imr_change_pending = true;
-	queue_work(wq, &sih->mask_work);
+	queue_work(wq, &sih_sync_work);
 	spin_unlock_irqrestore(&sih_agent_lock, flags);
 }
 
@@ -505,7 +649,7 @@ static void twl4030_sih_unmask(unsigned irq)
 	spin_lock_irqsave(&sih_agent_lock, flags);
 	sih->imr &= ~BIT(irq - sih->irq_base);
 	sih->imr_change_pending = true;
-	queue_work(wq, &sih->mask_work);
+	queue_work(wq, &sih_sync_work);
 	spin_unlock_irqrestore(&sih_agent_lock, flags);
 }
 
@@ -523,7 +667,7 @@ static int twl4030_sih_set_type(unsigned irq, unsigned trigger)
 		desc->status &= ~IRQ_TYPE_SENSE_MASK;
 		desc->status |= trigger;
 		sih->edge_change |= BIT(irq - sih->irq_base);
-		queue_work(wq, &sih->edge_work);
+		queue_work(wq, &sih_sync_work);
 	}
 	spin_unlock_irqrestore(&sih_agent_lock, flags);
 	return 0;
@@ -538,26 +682,9 @@ static struct irq_chip twl4030_sih_irq_chip = {
 
 /*----------------------------------------------------------------------*/
 
-static inline int sih_read_isr(const struct sih *sih)
-{
-	int status;
-	union {
-		u8 bytes[4];
-		u32 word;
-	} isr;
-
-	/* FIXME need retry-on-error ... */
-
-	isr.word = 0;
-	status = twl4030_i2c_read(sih->module, isr.bytes,
-			sih->mask[irq_line].isr_offset, sih->bytes_ixr);
-
-	return (status < 0) ? status : le32_to_cpu(isr.word);
-}
-
 /*
  * Generic handler for SIH interrupts ... we "know" this is called
- * in task context, with IRQs enabled.
+ * in task context, by the irq thread once it has read the ISR.
  */
 static void handle_twl4030_sih(unsigned irq, struct irq_desc *desc)
 {
@@ -565,17 +692,14 @@ static void handle_twl4030_sih(unsigned irq, struct irq_desc *desc)
 	const struct sih *sih = agent->sih;
 	int isr;
 
-	/* reading ISR acks the IRQs, using clear-on-read mode */
-	local_irq_enable();
-	isr = sih_read_isr(sih);
-	local_irq_disable();
-
-	if (isr < 0) {
+	/* twl4030_sih_read_isrs() already read (and so acked) the ISR */
+	if (agent->isr_status < 0) {
 		pr_err("twl4030: %s SIH, read ISR error %d\n",
-			sih->name, isr);
+			sih->name, agent->isr_status);
 		/* REVISIT:  recover; eventually mask it all, etc */
 		return;
 	}
+	isr = le32_to_cpu(agent->isr.word);
 
 	while (isr) {
 		irq = fls(isr);
@@ -629,8 +753,6 @@ int twl4030_sih_setup(int module)
 	agent->irq_base = irq_base;
 	agent->sih = sih;
 	agent->imr = ~0;
-	INIT_WORK(&agent->mask_work, twl4030_sih_do_mask);
-	INIT_WORK(&agent->edge_work, twl4030_sih_do_edge);
 
 	for (i = 0; i < sih->bits; i++) {
 		irq = irq_base + i;
@@ -646,6 +768,7 @@ int twl4030_sih_setup(int module)
 
 	/* replace generic PIH handler (handle_simple_irq) */
 	irq = sih_mod + twl4030_irq_base;
+	sih_agents[sih_mod] = agent;
 	set_irq_data(irq, agent);
 	set_irq_chained_handler(irq, handle_twl4030_sih);
 
@@ -658,6 +781,57 @@ int twl4030_sih_setup(int module)
 /* FIXME need a call to reverse twl4030_sih_setup() ... */
 
 
+/*----------------------------------------------------------------------*/
+
+#ifdef CONFIG_DEBUG_FS
+
+static int twl4030_irq_latency_show(struct seq_file *s, void *unused)
+{
+	struct irq_latency lat;
+	u64 mean;
+	int i;
+
+	seq_printf(s, "%-8s %10s %10s %10s %10s\n", "module", "count",
+			"last_us", "mean_us", "max_us");
+	for (i = 0; i < ARRAY_SIZE(irq_latency); i++) {
+		spin_lock_irq(&irq_latency_lock);
+		lat = irq_latency[i];
+		spin_unlock_irq(&irq_latency_lock);
+
+		mean = lat.count ? div_u64(lat.total_us, lat.count) : 0;
+		seq_printf(s, "%-8s %10lu %10u %10llu %10u\n",
+				sih_modules[i].name, lat.count, lat.last_us,
+				(unsigned long long)mean, lat.max_us);
+	}
+	return 0;
+}
+
+static int twl4030_irq_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, twl4030_irq_latency_show, NULL);
+}
+
+static const struct file_operations twl4030_irq_latency_fops = {
+	.open		= twl4030_irq_latency_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+static void twl4030_irq_debugfs_init(void)
+{
+	debugfs_create_file("twl4030-irq", 0444, NULL, NULL,
+			&twl4030_irq_latency_fops);
+}
+
+#else
+
+static inline void twl4030_irq_debugfs_init(void)
+{
+}
+
+#endif
+
 /*----------------------------------------------------------------------*/
 
 /* FIXME pass in which interrupt line we'll use ... */
@@ -684,6 +858,7 @@ int twl_init_irq(int irq_num, unsigned irq_base, unsigned irq_end)
 		pr_err("twl4030: workqueue FAIL\n");
 		return -ESRCH;
 	}
+	INIT_WORK(&sih_sync_work, twl4030_sih_sync);
 
 	twl4030_irq_base = irq_base;
 
@@ -722,6 +897,8 @@ int twl_init_irq(int irq_num, unsigned irq_base, unsigned irq_end)
 	set_irq_data(irq_num, task);
 	set_irq_chained_handler(irq_num, handle_twl4030_pih);
 
+	twl4030_irq_debugfs_init();
+
 	return status;
 
 fail:
@@ -16,11 +16,14 @@
 #include <linux/module.h>
 #include <linux/init.h>
 #include <linux/bug.h>
+#include <linux/err.h>
 #include <linux/device.h>
 #include <linux/delay.h>
 #include <linux/interrupt.h>
+#include <linux/sched.h>
 #include <linux/workqueue.h>
 
+#include <linux/mfd/regcache.h>
 #include <linux/mfd/wm8350/core.h>
 #include <linux/mfd/wm8350/audio.h>
 #include <linux/mfd/wm8350/comparator.h>
@@ -82,7 +85,7 @@ static int wm8350_phys_read(struct wm8350 *wm8350, u8 reg, int num_regs,
 
 		/* Satisfy non-volatile bits from cache */
 		dest[i - reg] &= wm8350_reg_io_map[i].vol;
-		dest[i - reg] |= wm8350->reg_cache[i];
+		dest[i - reg] |= regcache_read(wm8350->reg_cache, i);
 
 		/* Mask out non-readable bits */
 		dest[i - reg] &= wm8350_reg_io_map[i].readable;
@@ -98,7 +101,6 @@ static int wm8350_read(struct wm8350 *wm8350, u8 reg, int num_regs, u16 *dest)
 	int i;
 	int end = reg + num_regs;
 	int ret = 0;
-	int bytes = num_regs * 2;
 
 	if (wm8350->read_dev == NULL)
 		return -ENODEV;
@@ -128,7 +130,8 @@ static int wm8350_read(struct wm8350 *wm8350, u8 reg, int num_regs, u16 *dest)
 
 	/* no volatiles, then cache is good */
 	dev_dbg(wm8350->dev, "cache read\n");
-	memcpy(dest, &wm8350->reg_cache[reg], bytes);
+	for (i = reg; i < end; i++)
+		dest[i - reg] = regcache_read(wm8350->reg_cache, i);
 	dump(num_regs, dest);
 	return ret;
 }
@@ -136,7 +139,8 @@ static int wm8350_read(struct wm8350 *wm8350, u8 reg, int num_regs, u16 *dest)
 static inline int is_reg_locked(struct wm8350 *wm8350, u8 reg)
 {
 	if (reg == WM8350_SECURITY ||
-	    wm8350->reg_cache[WM8350_SECURITY] == WM8350_UNLOCK_KEY)
+	    regcache_read(wm8350->reg_cache, WM8350_SECURITY) ==
+	    WM8350_UNLOCK_KEY)
 		return 0;
 
 	if ((reg == WM8350_GPIO_CONFIGURATION_I_O) ||
@@ -148,11 +152,36 @@ static inline int is_reg_locked(struct wm8350 *wm8350, u8 reg)
 	return 0;
 }
 
+/* Writes to registers with volatile bits, and to the security register
+ * which gates writes to the locked registers, can't be held in the cache
+ * and must go straight to the device. */
+static inline int wm8350_reg_write_through(u8 reg, int num_regs)
+{
+	int i;
+
+	for (i = reg; i < reg + num_regs; i++)
+		if (wm8350_reg_io_map[i].vol || i == WM8350_SECURITY)
+			return 1;
+
+	return 0;
+}
+
+static inline int wm8350_reg_batchable(struct wm8350 *wm8350, u8 reg,
+				       int num_regs)
+{
+	if (wm8350->batch_owner != current)
+		return 0;
+
+	return !wm8350_reg_write_through(reg, num_regs);
+}
+
 static int wm8350_write(struct wm8350 *wm8350, u8 reg, int num_regs, u16 *src)
 {
 	int i;
 	int end = reg + num_regs;
 	int bytes = num_regs * 2;
+	int batch, ret;
+	u16 val;
 
 	if (wm8350->write_dev == NULL)
 		return -ENODEV;
@@ -163,6 +192,17 @@ static int wm8350_write(struct wm8350 *wm8350, u8 reg, int num_regs, u16 *src)
 		return -EINVAL;
 	}
 
+	batch = wm8350_reg_batchable(wm8350, reg, num_regs);
+
+	/* if this write can't be held, write out what our batch holds so
+	 * far first to keep the writes in order */
+	if (wm8350->batch_owner == current &&
+	    wm8350_reg_write_through(reg, num_regs)) {
+		ret = regcache_sync(wm8350->reg_cache);
+		if (ret != 0)
+			return ret;
+	}
+
 	/* it's generally not a good idea to write to RO or locked registers */
 	for (i = reg; i < end; i++) {
 		if (!wm8350_reg_io_map[i].writable) {
@@ -179,20 +219,60 @@ static int wm8350_write(struct wm8350 *wm8350, u8 reg, int num_regs, u16 *src)
 
 		src[i - reg] &= wm8350_reg_io_map[i].writable;
 
-		wm8350->reg_cache[i] =
-			(wm8350->reg_cache[i] & ~wm8350_reg_io_map[i].writable)
-			| src[i - reg];
+		val = (regcache_read(wm8350->reg_cache, i) &
+		       ~wm8350_reg_io_map[i].writable) | src[i - reg];
 
 		/* Don't store volatile bits */
-		wm8350->reg_cache[i] &= ~wm8350_reg_io_map[i].vol;
+		val &= ~wm8350_reg_io_map[i].vol;
+
+		ret = regcache_write(wm8350->reg_cache, i, val);
+		if (ret != 0)
+			return ret;
+
+		/* the cache now holds the latest value; either it goes out
+		 * with this write or on the next batch commit */
+		if (batch)
+			regcache_set_dirty(wm8350->reg_cache, i, 1);
 
 		src[i - reg] = cpu_to_be16(src[i - reg]);
 	}
 
+	if (batch)
+		return 0;
+
 	/* Actually write it out */
 	return wm8350->write_dev(wm8350, reg, bytes, (char *)src);
 }
 
+/*
+ * Register cache callbacks
+ */
+static int wm8350_cache_volatile(void *data, unsigned int reg)
+{
+	return wm8350_reg_io_map[reg].vol != 0;
+}
+
+static int wm8350_cache_writable(void *data, unsigned int reg)
+{
+	struct wm8350 *wm8350 = data;
+
+	return wm8350_reg_io_map[reg].writable && !is_reg_locked(wm8350, reg);
+}
+
+/* Write back registers from the cache.  io_mutex held by caller. */
+static int wm8350_cache_write(void *data, unsigned int reg, int count,
+			      u16 *src)
+{
+	struct wm8350 *wm8350 = data;
+	int i;
+
+	for (i = 0; i < count; i++)
+		src[i] = cpu_to_be16(src[i] &
+				     wm8350_reg_io_map[reg + i].writable);
+
+	return wm8350->write_dev(wm8350, reg, count * 2, (char *)src);
+}
+
 /*
  * Safe read, modify, write methods
  */
@@ -299,6 +379,65 @@ int wm8350_block_write(struct wm8350 *wm8350, int start_reg, int regs,
 }
 EXPORT_SYMBOL_GPL(wm8350_block_write);
 
+/**
+ * wm8350_reg_batch_begin - start batching register writes
+ *
+ * @wm8350: Device to batch writes for
+ *
+ * Until the matching wm8350_reg_batch_commit() writes made by the calling
+ * task to registers without volatile bits only update the register cache.
+ * The commit then writes them out, with adjacent registers combined into
+ * a single bus transfer.  Writes to registers with volatile bits and to
+ * the security register first write out everything held so far, so the
+ * device sees the writes in order.  Writes from other tasks are not
+ * affected.
+ *
+ * Batches nest; only the outermost commit writes to the device.  Only one
+ * task may have a batch open on a device at once, others will sleep here.
+ */
+void wm8350_reg_batch_begin(struct wm8350 *wm8350)
+{
+	if (wm8350->batch_owner == current) {
+		wm8350->batch_depth++;
+		return;
+	}
+
+	mutex_lock(&wm8350->batch_mutex);
+	mutex_lock(&io_mutex);
+	wm8350->batch_owner = current;
+	wm8350->batch_depth = 1;
+	mutex_unlock(&io_mutex);
+}
+EXPORT_SYMBOL_GPL(wm8350_reg_batch_begin);
+
+/**
+ * wm8350_reg_batch_commit - finish batching register writes
+ *
+ * @wm8350: Device to batch writes for
+ *
+ * Ends a batch started with wm8350_reg_batch_begin(), writing out any
+ * registers changed during it.  Registers which have been locked again
+ * since they were written are not written and -EPERM is returned.
+ */
+int wm8350_reg_batch_commit(struct wm8350 *wm8350)
+{
+	int ret;
+
+	BUG_ON(wm8350->batch_owner != current);
+
+	if (--wm8350->batch_depth)
+		return 0;
+
+	mutex_lock(&io_mutex);
+	ret = regcache_sync(wm8350->reg_cache);
+	wm8350->batch_owner = NULL;
+	mutex_unlock(&io_mutex);
+	mutex_unlock(&wm8350->batch_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(wm8350_reg_batch_commit);
+
 int wm8350_reg_lock(struct wm8350 *wm8350)
 {
 	u16 key = WM8350_LOCK_KEY;
@@ -350,29 +489,103 @@ static void wm8350_irq_call_handler(struct wm8350 *wm8350, int irq)
  * the physical IRQ will be handled again if another interrupt is
  * asserted while we run - in the normal course of events this is a
  * rare occurrence so we save I2C/SPI reads.
+ *
+ * The status registers are fetched with as few block reads as possible.
+ * The second level status registers are cleared by reading them, so only
+ * those flagged in the first level register are read.  The mask registers
+ * are never changed by the device so they are taken from the register
+ * cache.
  */
+#define WM8350_INT_REGS	(WM8350_COMPARATOR_INT_STATUS - \
+			 WM8350_SYSTEM_INTERRUPTS + 1)
+
+/* Should the status register reg be read for the first level status? */
+static int wm8350_irq_status_wanted(u16 level_one, int reg)
+{
+	switch (reg) {
+	case WM8350_SYSTEM_INTERRUPTS:
+	case WM8350_INT_STATUS_1:
+	case WM8350_INT_STATUS_2:
+	case WM8350_COMPARATOR_INT_STATUS:
+		return 1;
+	case WM8350_UNDER_VOLTAGE_INT_STATUS:
+		return level_one & WM8350_UV_INT;
+	case WM8350_OVER_CURRENT_INT_STATUS:
+		return level_one & WM8350_OC_INT;
+	case WM8350_GPIO_INT_STATUS:
+		return level_one & WM8350_GP_INT;
+	default:
+		return 0;
+	}
+}
+
+static int wm8350_irq_read_status(struct wm8350 *wm8350, u16 *status)
+{
+	u16 level_one;
+	int i, end, ret;
+
+	ret = wm8350_block_read(wm8350, WM8350_SYSTEM_INTERRUPTS,
+				WM8350_INT_STATUS_2 - WM8350_SYSTEM_INTERRUPTS + 1,
+				status);
+	if (ret != 0)
+		return ret;
+
+	level_one = status[0] & ~regcache_read(wm8350->reg_cache,
+					       WM8350_SYSTEM_INTERRUPTS_MASK);
+
+	/* read each run of wanted registers after INT_STATUS_2 in one go */
+	i = WM8350_INT_STATUS_2 - WM8350_SYSTEM_INTERRUPTS + 1;
+	while (i < WM8350_INT_REGS) {
+		if (!wm8350_irq_status_wanted(level_one,
+					      WM8350_SYSTEM_INTERRUPTS + i)) {
+			status[i++] = 0;
+			continue;
+		}
+
+		end = i + 1;
+		while (end < WM8350_INT_REGS &&
+		       wm8350_irq_status_wanted(level_one,
+						WM8350_SYSTEM_INTERRUPTS + end))
+			end++;
+
+		ret = wm8350_block_read(wm8350, WM8350_SYSTEM_INTERRUPTS + i,
+					end - i, &status[i]);
+		if (ret != 0)
+			return ret;
+		i = end;
+	}
+
+	return 0;
+}
+
 static void wm8350_irq_worker(struct work_struct *work)
 {
 	struct wm8350 *wm8350 = container_of(work, struct wm8350, irq_work);
+	u16 status[WM8350_INT_REGS];
 	u16 level_one, status1, status2, comp;
+	int i, ret;
 
-	/* TODO: Use block reads to improve performance? */
-	level_one = wm8350_reg_read(wm8350, WM8350_SYSTEM_INTERRUPTS)
-		& ~wm8350_reg_read(wm8350, WM8350_SYSTEM_INTERRUPTS_MASK);
-	status1 = wm8350_reg_read(wm8350, WM8350_INT_STATUS_1)
-		& ~wm8350_reg_read(wm8350, WM8350_INT_STATUS_1_MASK);
-	status2 = wm8350_reg_read(wm8350, WM8350_INT_STATUS_2)
-		& ~wm8350_reg_read(wm8350, WM8350_INT_STATUS_2_MASK);
-	comp = wm8350_reg_read(wm8350, WM8350_COMPARATOR_INT_STATUS)
-		& ~wm8350_reg_read(wm8350, WM8350_COMPARATOR_INT_STATUS_MASK);
+	ret = wm8350_irq_read_status(wm8350, status);
+	if (ret != 0) {
+		dev_err(wm8350->dev, "failed to read interrupt status: %d\n",
+			ret);
+		goto out;
+	}
+
+	/* only bits which are both set and unmasked are dispatched */
+	for (i = 0; i < WM8350_INT_REGS; i++)
+		status[i] &= ~regcache_read(wm8350->reg_cache,
+					    WM8350_SYSTEM_INTERRUPTS_MASK + i);
+
+	level_one = status[WM8350_SYSTEM_INTERRUPTS - WM8350_SYSTEM_INTERRUPTS];
+	status1 = status[WM8350_INT_STATUS_1 - WM8350_SYSTEM_INTERRUPTS];
+	status2 = status[WM8350_INT_STATUS_2 - WM8350_SYSTEM_INTERRUPTS];
+	comp = status[WM8350_COMPARATOR_INT_STATUS - WM8350_SYSTEM_INTERRUPTS];
 
 	/* over current */
 	if (level_one & WM8350_OC_INT) {
-		u16 oc;
-
-		oc = wm8350_reg_read(wm8350, WM8350_OVER_CURRENT_INT_STATUS);
-		oc &= ~wm8350_reg_read(wm8350,
-				       WM8350_OVER_CURRENT_INT_STATUS_MASK);
+		u16 oc = status[WM8350_OVER_CURRENT_INT_STATUS -
+				WM8350_SYSTEM_INTERRUPTS];
 
 		if (oc & WM8350_OC_LS_EINT)	/* limit switch */
 			wm8350_irq_call_handler(wm8350, WM8350_IRQ_OC_LS);
@@ -380,11 +593,8 @@ static void wm8350_irq_worker(struct work_struct *work)
 
 	/* under voltage */
 	if (level_one & WM8350_UV_INT) {
-		u16 uv;
-
-		uv = wm8350_reg_read(wm8350, WM8350_UNDER_VOLTAGE_INT_STATUS);
-		uv &= ~wm8350_reg_read(wm8350,
-				       WM8350_UNDER_VOLTAGE_INT_STATUS_MASK);
+		u16 uv = status[WM8350_UNDER_VOLTAGE_INT_STATUS -
+				WM8350_SYSTEM_INTERRUPTS];
 
 		if (uv & WM8350_UV_DC1_EINT)
 			wm8350_irq_call_handler(wm8350, WM8350_IRQ_UV_DC1);
@@ -530,12 +740,8 @@ static void wm8350_irq_worker(struct work_struct *work)
 	}
 
 	if (level_one & WM8350_GP_INT) {
-		int i;
-		u16 gpio;
-
-		gpio = wm8350_reg_read(wm8350, WM8350_GPIO_INT_STATUS);
-		gpio &= ~wm8350_reg_read(wm8350,
-					 WM8350_GPIO_INT_STATUS_MASK);
+		u16 gpio = status[WM8350_GPIO_INT_STATUS -
+				  WM8350_SYSTEM_INTERRUPTS];
 
 		for (i = 0; i < 12; i++) {
 			if (gpio & (1 << i))
@@ -544,6 +750,7 @@ static void wm8350_irq_worker(struct work_struct *work)
 		}
 	}
 
+out:
 	enable_irq(wm8350->chip_irq);
 }
 
@@ -1066,14 +1273,36 @@ int wm8350_unmask_irq(struct wm8350 *wm8350, int irq)
 }
 EXPORT_SYMBOL_GPL(wm8350_unmask_irq);
 
+/*
+ * Registers which are not read back when the cache is created: the
+ * audio registers and anything not readable take the mode defaults.
+ */
+static inline int wm8350_cache_from_defaults(int reg)
+{
+	/* audio register range */
+	if (reg >= WM8350_CLOCK_CONTROL_1 && reg <= WM8350_AIF_TEST)
+		return 1;
+	return !wm8350_reg_io_map[reg].readable;
+}
+
 /*
  * Cache is always host endian.
  */
 static int wm8350_create_cache(struct wm8350 *wm8350, int mode)
 {
-	int i, ret = 0;
-	u16 value;
+	struct regcache_config config = {
+		.type = REGCACHE_FLAT,
+		.max_register = WM8350_MAX_REGISTER,
+		.volatile_reg = wm8350_cache_volatile,
+		.writable_reg = wm8350_cache_writable,
+		.write = wm8350_cache_write,
+		/* the most the I2C write buffer takes */
+		.max_block = WM8350_MAX_REGISTER,
+		.data = wm8350,
+	};
+	int i, start, end, ret = 0;
 	const u16 *reg_map;
+	u16 value, *buf;
 
 	switch (mode) {
 #ifdef CONFIG_MFD_WM8350_CONFIG_MODE_0
@@ -1102,34 +1331,69 @@ static int wm8350_create_cache(struct wm8350 *wm8350, int mode)
 		return -EINVAL;
 	}
 
-	wm8350->reg_cache =
-	    kzalloc(sizeof(u16) * (WM8350_MAX_REGISTER + 1), GFP_KERNEL);
-	if (wm8350->reg_cache == NULL)
-		return -ENOMEM;
+	/* the cache holds every register so the mode defaults cover
+	 * anything which isn't read back */
+	config.defaults = reg_map;
+	wm8350->reg_cache = regcache_init(&config);
+	if (IS_ERR(wm8350->reg_cache)) {
+		ret = PTR_ERR(wm8350->reg_cache);
+		wm8350->reg_cache = NULL;
+		return ret;
+	}
+
+	buf = kmalloc(sizeof(u16) * (WM8350_MAX_REGISTER + 1), GFP_KERNEL);
+	if (buf == NULL) {
+		ret = -ENOMEM;
+		goto err;
+	}
 
 	/* Read the initial cache state back from the device - this is
 	 * a PMIC so the device many not be in a virgin state and we
 	 * can't rely on the silicon values.
+	 *
+	 * Each run of adjacent registers to be read is fetched with a single
+	 * block read.  Runs stop at unreadable registers, which are never
+	 * read and keep their defaults.
 	 */
-	for (i = 0; i < WM8350_MAX_REGISTER; i++) {
-		/* audio register range */
-		if (wm8350_reg_io_map[i].readable &&
-		    (i < WM8350_CLOCK_CONTROL_1 || i > WM8350_AIF_TEST)) {
-			ret = wm8350->read_dev(wm8350, i, 2, (char *)&value);
-			if (ret < 0) {
-				dev_err(wm8350->dev,
-				       "failed to read initial cache value\n");
-				goto out;
-			}
-			value = be16_to_cpu(value);
+	start = 0;
+	while (start < WM8350_MAX_REGISTER) {
+		if (wm8350_cache_from_defaults(start)) {
+			start++;
+			continue;
+		}
+
+		end = start + 1;
+		while (end < WM8350_MAX_REGISTER &&
+		       !wm8350_cache_from_defaults(end))
+			end++;
+
+		ret = wm8350->read_dev(wm8350, start, (end - start) * 2,
+				       (char *)buf);
+		if (ret < 0) {
+			dev_err(wm8350->dev,
+				"failed to read initial cache values R%d-R%d\n",
+				start, end - 1);
+			goto err_buf;
+		}
+
+		for (i = start; i < end; i++) {
+			value = be16_to_cpu(buf[i - start]);
 			value &= wm8350_reg_io_map[i].readable;
 			value &= ~wm8350_reg_io_map[i].vol;
-			wm8350->reg_cache[i] = value;
-		} else
-			wm8350->reg_cache[i] = reg_map[i];
+			regcache_write(wm8350->reg_cache, i, value);
+		}
+
+		start = end;
 	}
 
-out:
+	kfree(buf);
+	return 0;
+
+err_buf:
+	kfree(buf);
+err:
+	regcache_exit(wm8350->reg_cache);
+	wm8350->reg_cache = NULL;
 	return ret;
 }
 
@@ -1208,6 +1472,7 @@ int wm8350_device_init(struct wm8350 *wm8350, int irq,
 		printk(KERN_ERR "wm8350: failed to create register cache\n");
 		return ret;
 	}
+	mutex_init(&wm8350->batch_mutex);
 
 	if (pdata->init) {
 		ret = pdata->init(wm8350);
@@ -1248,7 +1513,7 @@ int wm8350_device_init(struct wm8350 *wm8350, int irq,
 	return 0;
 
 err:
-	kfree(wm8350->reg_cache);
+	regcache_exit(wm8350->reg_cache);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(wm8350_device_init);
@@ -1268,7 +1533,7 @@ void wm8350_device_exit(struct wm8350 *wm8350)
 
 	free_irq(wm8350->chip_irq, wm8350);
 	flush_work(&wm8350->irq_work);
-	kfree(wm8350->reg_cache);
+	regcache_exit(wm8350->reg_cache);
 }
 EXPORT_SYMBOL_GPL(wm8350_device_exit);
 
@@ -19,21 +19,53 @@
 #include <linux/moduleparam.h>
 #include <linux/init.h>
 #include <linux/i2c.h>
+#include <linux/completion.h>
 #include <linux/platform_device.h>
 #include <linux/mfd/wm8350/core.h>
 
+static void wm8350_i2c_read_complete(struct i2c_request *req)
+{
+	complete(req->context);
+}
+
 static int wm8350_i2c_read_device(struct wm8350 *wm8350, char reg,
 				  int bytes, void *dest)
 {
+	struct i2c_client *i2c = wm8350->i2c_client;
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct i2c_msg msgs[2];
+	struct i2c_request req;
 	int ret;
 
-	ret = i2c_master_send(wm8350->i2c_client, &reg, 1);
+	msgs[0].addr = i2c->addr;
+	msgs[0].flags = i2c->flags & I2C_M_TEN;
+	msgs[0].len = 1;
+	msgs[0].buf = (u8 *)&reg;
+
+	msgs[1].addr = i2c->addr;
+	msgs[1].flags = (i2c->flags & I2C_M_TEN) | I2C_M_RD;
+	msgs[1].len = bytes;
+	msgs[1].buf = dest;
+
+	/* interrupt status reads go ahead of other queued bus traffic */
+	req.msgs = msgs;
+	req.num = 2;
+	if ((u8)reg >= WM8350_SYSTEM_INTERRUPTS &&
+	    (u8)reg <= WM8350_COMPARATOR_INT_STATUS)
+		req.prio = I2C_PRIO_HIGH;
+	else
+		req.prio = I2C_PRIO_NORMAL;
+	req.complete = wm8350_i2c_read_complete;
+	req.context = &done;
+
+	ret = i2c_transfer_async(i2c->adapter, &req);
 	if (ret < 0)
 		return ret;
-	ret = i2c_master_recv(wm8350->i2c_client, dest, bytes);
-	if (ret < 0)
-		return ret;
-	if (ret != bytes)
+	wait_for_completion(&done);
+
+	if (req.status < 0)
+		return req.status;
+	if (req.status != 2)
 		return -EIO;
 	return 0;
 }
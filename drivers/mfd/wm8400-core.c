@@ -13,8 +13,11 @@
  */
 
 #include <linux/bug.h>
+#include <linux/err.h>
 #include <linux/i2c.h>
 #include <linux/kernel.h>
+#include <linux/sched.h>
+#include <linux/mfd/regcache.h>
 #include <linux/mfd/wm8400-private.h>
 #include <linux/mfd/wm8400-audio.h>
 
@@ -112,15 +115,22 @@ static struct {
 	{ 0x80FF, 0x80FF, 0x0000, 0, 0x00ff }, /* R84 */
 };
 
+/* Registers with volatile bits, these are always read from the device */
+static const struct regcache_range wm8400_volatile[] = {
+	{ WM8400_ID, WM8400_ID },
+	{ WM8400_INTERRUPT_STATUS_1, WM8400_INTERRUPT_STATUS_1 },
+	{ WM8400_INTERRUPT_LEVELS, WM8400_SHUTDOWN_REASON },
+};
+
 static int wm8400_read(struct wm8400 *wm8400, u8 reg, int num_regs, u16 *dest)
 {
 	int i, ret = 0;
 
-	BUG_ON(reg + num_regs - 1 > ARRAY_SIZE(wm8400->reg_cache));
+	BUG_ON(reg + num_regs > WM8400_REGISTER_COUNT);
 
 	/* If there are any volatile reads then read back the entire block */
 	for (i = reg; i < reg + num_regs; i++)
-		if (reg_data[i].vol) {
+		if (regcache_volatile(wm8400->reg_cache, i)) {
 			ret = wm8400->read_dev(wm8400->io_data, reg,
 					       num_regs, dest);
 			if (ret != 0)
@@ -132,24 +142,58 @@ static int wm8400_read(struct wm8400 *wm8400, u8 reg, int num_regs, u16 *dest)
 		}
 
 	/* Otherwise use the cache */
-	memcpy(dest, &wm8400->reg_cache[reg], num_regs * sizeof(u16));
+	for (i = 0; i < num_regs; i++)
+		dest[i] = regcache_read(wm8400->reg_cache, reg + i);
 
 	return 0;
 }
 
+/* Only registers with no volatile bits can have their writes deferred */
+static int wm8400_reg_batchable(struct wm8400 *wm8400, u8 reg, int num_regs)
+{
+	int i;
+
+	if (wm8400->batch_owner != current)
+		return 0;
+
+	for (i = reg; i < reg + num_regs; i++)
+		if (regcache_volatile(wm8400->reg_cache, i))
+			return 0;
+
+	return 1;
+}
+
 static int wm8400_write(struct wm8400 *wm8400, u8 reg, int num_regs,
 			u16 *src)
 {
-	int ret, i;
+	int ret, i, batch;
+
+	BUG_ON(reg + num_regs > WM8400_REGISTER_COUNT);
 
-	BUG_ON(reg + num_regs - 1 > ARRAY_SIZE(wm8400->reg_cache));
+	batch = wm8400_reg_batchable(wm8400, reg, num_regs);
+
+	/* write out anything held by our batch first to keep the writes
+	 * in order */
+	if (!batch && wm8400->batch_owner == current) {
+		ret = regcache_sync(wm8400->reg_cache);
+		if (ret != 0)
+			return ret;
+	}
 
 	for (i = 0; i < num_regs; i++) {
 		BUG_ON(!reg_data[reg + i].writable);
-		wm8400->reg_cache[reg + i] = src[i];
+		ret = regcache_write(wm8400->reg_cache, reg + i, src[i]);
+		if (ret != 0)
+			return ret;
+		if (batch)
+			regcache_set_dirty(wm8400->reg_cache, reg + i, 1);
 		src[i] = cpu_to_be16(src[i]);
 	}
 
+	/* held writes go out on the next batch commit */
+	if (batch)
+		return 0;
+
 	/* Do the actual I/O */
 	ret = wm8400->write_dev(wm8400->io_data, reg, num_regs, src);
 	if (ret != 0)
@@ -220,6 +264,80 @@ int wm8400_set_bits(struct wm8400 *wm8400, u8 reg, u16 mask, u16 val)
 }
 EXPORT_SYMBOL_GPL(wm8400_set_bits);
 
+/*
+ * Register cache callbacks
+ */
+static int wm8400_cache_writable(void *data, unsigned int reg)
+{
+	return reg_data[reg].writable != 0;
+}
+
+/* Write back registers from the cache.  io_lock held by caller. */
+static int wm8400_cache_write(void *data, unsigned int reg, int count,
+			      u16 *src)
+{
+	struct wm8400 *wm8400 = data;
+	int i;
+
+	for (i = 0; i < count; i++)
+		src[i] = cpu_to_be16(src[i]);
+
+	if (wm8400->write_dev(wm8400->io_data, reg, count, src))
+		return -EIO;
+	return 0;
+}
+
+/**
+ * wm8400_reg_batch_begin - Start batching register writes
+ *
+ * @wm8400: Pointer to wm8400 control structure
+ *
+ * Until the matching wm8400_reg_batch_commit() writes by the calling
+ * task to non-volatile registers only update the register cache.  The
+ * commit writes them out, combining adjacent registers into a single
+ * transfer.  Batches nest and only one task may hold a batch at once.
+ */
+void wm8400_reg_batch_begin(struct wm8400 *wm8400)
+{
+	if (wm8400->batch_owner == current) {
+		wm8400->batch_depth++;
+		return;
+	}
+
+	mutex_lock(&wm8400->batch_lock);
+	mutex_lock(&wm8400->io_lock);
+	wm8400->batch_owner = current;
+	wm8400->batch_depth = 1;
+	mutex_unlock(&wm8400->io_lock);
+}
+EXPORT_SYMBOL_GPL(wm8400_reg_batch_begin);
+
+/**
+ * wm8400_reg_batch_commit - Finish batching register writes
+ *
+ * @wm8400: Pointer to wm8400 control structure
+ *
+ * @return  Zero on success or a negative error from the bus write
+ */
+int wm8400_reg_batch_commit(struct wm8400 *wm8400)
+{
+	int ret;
+
+	BUG_ON(wm8400->batch_owner != current);
+
+	if (--wm8400->batch_depth)
+		return 0;
+
+	mutex_lock(&wm8400->io_lock);
+	ret = regcache_sync(wm8400->reg_cache);
+	wm8400->batch_owner = NULL;
+	mutex_unlock(&wm8400->io_lock);
+	mutex_unlock(&wm8400->batch_lock);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(wm8400_reg_batch_commit);
+
 /**
  * wm8400_reset_codec_reg_cache - Reset cached codec registers to
  * their default values.
@@ -231,9 +349,10 @@ void wm8400_reset_codec_reg_cache(struct wm8400 *wm8400)
 	mutex_lock(&wm8400->io_lock);
 
 	/* Reset all codec registers to their initial value */
-	for (i = 0; i < ARRAY_SIZE(wm8400->reg_cache); i++)
+	for (i = 0; i < WM8400_REGISTER_COUNT; i++)
 		if (reg_data[i].is_codec)
-			wm8400->reg_cache[i] = reg_data[i].default_val;
+			regcache_write(wm8400->reg_cache, i,
+				       reg_data[i].default_val);
 
 	mutex_unlock(&wm8400->io_lock);
 }
@@ -249,10 +368,20 @@ EXPORT_SYMBOL_GPL(wm8400_reset_codec_reg_cache);
 static int wm8400_init(struct wm8400 *wm8400,
 		       struct wm8400_platform_data *pdata)
 {
-	u16 reg;
+	struct regcache_config config = {
+		.type = REGCACHE_FLAT,
+		.max_register = WM8400_REGISTER_COUNT - 1,
+		.volatile_ranges = wm8400_volatile,
+		.num_volatile_ranges = ARRAY_SIZE(wm8400_volatile),
+		.writable_reg = wm8400_cache_writable,
+		.write = wm8400_cache_write,
+		.data = wm8400,
+	};
+	u16 reg, regs[WM8400_REGISTER_COUNT];
 	int ret, i;
 
 	mutex_init(&wm8400->io_lock);
+	mutex_init(&wm8400->batch_lock);
 
 	wm8400->dev->driver_data = wm8400;
 
@@ -268,25 +397,36 @@ static int wm8400_init(struct wm8400 *wm8400,
 		return -ENODEV;
 	}
 
+	wm8400->reg_cache = regcache_init(&config);
+	if (IS_ERR(wm8400->reg_cache)) {
+		ret = PTR_ERR(wm8400->reg_cache);
+		wm8400->reg_cache = NULL;
+		dev_err(wm8400->dev, "Failed to create register cache: %d\n",
+			ret);
+		return ret;
+	}
+
 	/* We don't know what state the hardware is in and since this
 	 * is a PMIC we can't reset it safely so initialise the register
 	 * cache from the hardware.
 	 */
-	ret = wm8400->read_dev(wm8400->io_data, 0,
-			       ARRAY_SIZE(wm8400->reg_cache),
-			       wm8400->reg_cache);
+	ret = wm8400->read_dev(wm8400->io_data, 0, WM8400_REGISTER_COUNT,
+			       regs);
 	if (ret != 0) {
 		dev_err(wm8400->dev, "Register cache read failed\n");
 		return -EIO;
 	}
-	for (i = 0; i < ARRAY_SIZE(wm8400->reg_cache); i++)
-		wm8400->reg_cache[i] = be16_to_cpu(wm8400->reg_cache[i]);
+	for (i = 0; i < WM8400_REGISTER_COUNT; i++)
+		regs[i] = be16_to_cpu(regs[i]);
 
 	/* If the codec is in reset use hard coded values */
-	if (!(wm8400->reg_cache[WM8400_POWER_MANAGEMENT_1] & WM8400_CODEC_ENA))
-		for (i = 0; i < ARRAY_SIZE(wm8400->reg_cache); i++)
+	if (!(regs[WM8400_POWER_MANAGEMENT_1] & WM8400_CODEC_ENA))
+		for (i = 0; i < WM8400_REGISTER_COUNT; i++)
 			if (reg_data[i].is_codec)
-				wm8400->reg_cache[i] = reg_data[i].default_val;
+				regs[i] = reg_data[i].default_val;
+
+	for (i = 0; i < WM8400_REGISTER_COUNT; i++)
+		regcache_write(wm8400->reg_cache, i, regs[i]);
 
 	ret = wm8400_read(wm8400, WM8400_ID, 1, &reg);
 	if (ret != 0) {
@@ -314,6 +454,8 @@ static void wm8400_release(struct wm8400 *wm8400)
 	for (i = 0; i < ARRAY_SIZE(wm8400->regulators); i++)
 		if (wm8400->regulators[i].name)
 			platform_device_unregister(&wm8400->regulators[i]);
+
+	regcache_exit(wm8400->reg_cache);
 }
 
 #if defined(CONFIG_I2C) || defined(CONFIG_I2C_MODULE)
@@ -395,6 +537,7 @@ static int wm8400_i2c_probe(struct i2c_client *i2c,
 	return 0;
 
 struct_err:
+	regcache_exit(wm8400->reg_cache);
 	i2c_set_clientdata(i2c, NULL);
 	kfree(wm8400);
 err:
@@ -0,0 +1,266 @@
+/*
+ * bench-consumer.c  --  Regulator core stress benchmark
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Starts a number of threads which each repeatedly get a supply, enable
+ * it, change its voltage, disable it and put it again, then reports the
+ * throughput and latency percentiles of each operation.  Thread n uses
+ * supply n % supplies, named by the supply prefix followed by that number
+ * (sim0, sim1, ... by default), so with the simulated PMIC from
+ * sim-regulator several threads can be made to contend for the same rails
+ * and supply chains.
+ *
+ * e.g. modprobe bench-consumer threads=16 iterations=1000 supplies=4
+ *
+ * The benchmark runs when the module is loaded and the results go to the
+ * kernel log.
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/completion.h>
+#include <linux/kthread.h>
+#include <linux/ktime.h>
+#include <linux/sort.h>
+#include <linux/vmalloc.h>
+#include <linux/regulator/consumer.h>
+
+static int threads = 4;
+module_param(threads, int, 0444);
+MODULE_PARM_DESC(threads, "Number of consumer threads");
+
+static int iterations = 1000;
+module_param(iterations, int, 0444);
+MODULE_PARM_DESC(iterations, "Cycles run by each thread");
+
+static int supplies = 1;
+module_param(supplies, int, 0444);
+MODULE_PARM_DESC(supplies, "Number of supplies shared by the threads");
+
+static char *supply = "sim";
+module_param(supply, charp, 0444);
+MODULE_PARM_DESC(supply, "Name of supply n without the number n");
+
+static int min_uV = 1000000;
+module_param(min_uV, int, 0444);
+MODULE_PARM_DESC(min_uV, "Lowest voltage requested");
+
+static int max_uV = 1800000;
+module_param(max_uV, int, 0444);
+MODULE_PARM_DESC(max_uV, "Highest voltage requested");
+
+enum bench_op {
+	BENCH_GET,
+	BENCH_ENABLE,
+	BENCH_SET_VOLTAGE,
+	BENCH_DISABLE,
+	BENCH_PUT,
+	BENCH_OPS,
+};
+
+static const char *bench_op_names[BENCH_OPS] = {
+	[BENCH_GET] = "get",
+	[BENCH_ENABLE] = "enable",
+	[BENCH_SET_VOLTAGE] = "set_voltage",
+	[BENCH_DISABLE] = "disable",
+	[BENCH_PUT] = "put",
+};
+
+struct bench_thread {
+	int id;
+	int started;
+	int errors;
+	u32 *lat[BENCH_OPS]; /* ns for each cycle */
+};
+
+static struct bench_thread *bench_threads;
+static DECLARE_COMPLETION(bench_start);
+static atomic_t bench_running;
+static DECLARE_COMPLETION(bench_done);
+
+static u32 bench_since(ktime_t start)
+{
+	s64 ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return min_t(s64, ns, ~0U);
+}
+
+static void bench_cycle(struct bench_thread *t, const char *name, int i)
+{
+	struct regulator *regulator;
+	ktime_t start;
+	int ret, step;
+
+	/* move around within the range so the core has work to do */
+	step = (max_uV - min_uV) / 4;
+
+	start = ktime_get();
+	regulator = regulator_get(NULL, name);
+	t->lat[BENCH_GET][i] = bench_since(start);
+	if (IS_ERR(regulator)) {
+		t->errors++;
+		return;
+	}
+
+	start = ktime_get();
+	ret = regulator_enable(regulator);
+	t->lat[BENCH_ENABLE][i] = bench_since(start);
+	if (ret != 0)
+		t->errors++;
+
+	start = ktime_get();
+	if (regulator_set_voltage(regulator, min_uV + (i % 4) * step,
+				  max_uV) != 0)
+		t->errors++;
+	t->lat[BENCH_SET_VOLTAGE][i] = bench_since(start);
+
+	start = ktime_get();
+	if (ret == 0 && regulator_disable(regulator) != 0)
+		t->errors++;
+	t->lat[BENCH_DISABLE][i] = bench_since(start);
+
+	start = ktime_get();
+	regulator_put(regulator);
+	t->lat[BENCH_PUT][i] = bench_since(start);
+}
+
+static int bench_thread(void *data)
+{
+	struct bench_thread *t = data;
+	char name[32];
+	int i;
+
+	snprintf(name, sizeof(name), "%s%d", supply, t->id % supplies);
+
+	wait_for_completion(&bench_start);
+	for (i = 0; i < iterations; i++)
+		bench_cycle(t, name, i);
+
+	if (atomic_dec_and_test(&bench_running))
+		complete(&bench_done);
+	return 0;
+}
+
+static int bench_cmp(const void *a, const void *b)
+{
+	u32 x = *(const u32 *)a, y = *(const u32 *)b;
+
+	if (x < y)
+		return -1;
+	return x > y;
+}
+
+/* Merge and sort the latencies of every thread for one operation */
+static void bench_report(enum bench_op op, u32 *all)
+{
+	int i, n = 0;
+
+	for (i = 0; i < threads; i++) {
+		if (!bench_threads[i].started)
+			continue;
+		memcpy(&all[n], bench_threads[i].lat[op],
+		       iterations * sizeof(u32));
+		n += iterations;
+	}
+	sort(all, n, sizeof(u32), bench_cmp, NULL);
+
+	printk(KERN_INFO "regulator bench: %-11s p50 %u p90 %u p99 %u "
+	       "max %u ns\n", bench_op_names[op], all[n / 2],
+	       all[n * 9 / 10], all[n * 99 / 100], all[n - 1]);
+}
+
+static void bench_free(void)
+{
+	int i, j;
+
+	for (i = 0; i < threads; i++)
+		for (j = 0; j < BENCH_OPS; j++)
+			vfree(bench_threads[i].lat[j]);
+	kfree(bench_threads);
+}
+
+static int __init bench_init(void)
+{
+	struct task_struct *task;
+	ktime_t start;
+	u64 cycles;
+	u32 *all;
+	u32 ms;
+	int i, j, started = 0, errors = 0;
+
+	if (threads <= 0 || iterations <= 0 || supplies <= 0 ||
+	    min_uV > max_uV)
+		return -EINVAL;
+
+	bench_threads = kzalloc(threads * sizeof(*bench_threads), GFP_KERNEL);
+	if (bench_threads == NULL)
+		return -ENOMEM;
+
+	for (i = 0; i < threads; i++) {
+		bench_threads[i].id = i;
+		for (j = 0; j < BENCH_OPS; j++) {
+			bench_threads[i].lat[j] = vmalloc(iterations *
+							  sizeof(u32));
+			if (bench_threads[i].lat[j] == NULL)
+				goto nomem;
+		}
+	}
+	all = vmalloc(threads * iterations * sizeof(u32));
+	if (all == NULL)
+		goto nomem;
+
+	/* threads which fail to start just don't take part */
+	atomic_set(&bench_running, threads);
+	for (i = 0; i < threads; i++) {
+		task = kthread_run(bench_thread, &bench_threads[i],
+				   "regbench/%d", i);
+		if (IS_ERR(task)) {
+			printk(KERN_ERR "%s: failed to start thread %d: %ld\n",
+			       __func__, i, PTR_ERR(task));
+			if (atomic_dec_and_test(&bench_running))
+				complete(&bench_done);
+			continue;
+		}
+		bench_threads[i].started = 1;
+		started++;
+	}
+
+	start = ktime_get();
+	complete_all(&bench_start);
+	wait_for_completion(&bench_done);
+	ms = div_u64(ktime_to_us(ktime_sub(ktime_get(), start)), 1000);
+
+	for (i = 0; i < threads; i++)
+		errors += bench_threads[i].errors;
+	cycles = (u64)started * iterations;
+
+	printk(KERN_INFO "regulator bench: %d threads on %d supplies, "
+	       "%llu cycles in %u ms, %llu cycles/s, %d errors\n",
+	       started, supplies, cycles, ms,
+	       div_u64(cycles * 1000, max_t(u32, ms, 1)), errors);
+	if (started)
+		for (j = 0; j < BENCH_OPS; j++)
+			bench_report(j, all);
+
+	vfree(all);
+	bench_free();
+	return 0;
+
+nomem:
+	bench_free();
+	return -ENOMEM;
+}
+module_init(bench_init);
+
+static void __exit bench_exit(void)
+{
+}
+module_exit(bench_exit);
+
+MODULE_DESCRIPTION("Regulator core stress benchmark");
+MODULE_LICENSE("GPL");
@@ -16,18 +16,70 @@
 #include <linux/kernel.h>
 #include <linux/init.h>
 #include <linux/device.h>
+#include <linux/debugfs.h>
 #include <linux/err.h>
+#include <linux/jhash.h>
+#include <linux/miscdevice.h>
 #include <linux/mutex.h>
+#include <linux/poll.h>
+#include <linux/rwsem.h>
 #include <linux/suspend.h>
+#include <linux/completion.h>
+#include <linux/cpu.h>
+#include <linux/delay.h>
+#include <linux/hrtimer.h>
+#include <linux/sched.h>
+#include <linux/seqlock.h>
+#include <linux/seq_file.h>
+#include <linux/sort.h>
+#include <linux/uaccess.h>
+#include <linux/workqueue.h>
 #include <linux/regulator/consumer.h>
 #include <linux/regulator/driver.h>
+#include <linux/regulator/event.h>
 #include <linux/regulator/machine.h>
+#include <trace/regulator.h>
 
 #define REGULATOR_VERSION "0.5"
 
+/* settling waits shorter than this are not worth sleeping for */
+#define REGULATOR_SETTLE_SPIN_US	10
+
+#define REGULATOR_MAP_HASH_BITS	6
+#define REGULATOR_MAP_HASH_SIZE	(1 << REGULATOR_MAP_HASH_BITS)
+
+#define REGULATOR_STAT_BUCKETS	16
+
+/* highest lockdep subclass used when locking a supply chain */
+#define REGULATOR_LOCK_SUBCLASS_MAX	7
+
+DEFINE_TRACE(regulator_op_start);
+DEFINE_TRACE(regulator_op_end);
+
 static DEFINE_MUTEX(regulator_list_mutex);
 static LIST_HEAD(regulator_list);
-static LIST_HEAD(regulator_map_list);
+static struct workqueue_struct *regulator_wq;
+
+/* Runs the parallel parts of regulator_bulk_enable() and
+ * regulator_suspend_prepare().  Nothing queued here waits for other work,
+ * so callers running on regulator_wq can safely wait for it. */
+static struct workqueue_struct *regulator_parallel_wq;
+
+/* supply maps hashed on consumer device and supply name */
+static DECLARE_RWSEM(regulator_map_sem);
+static struct hlist_head regulator_map_hash[REGULATOR_MAP_HASH_SIZE];
+
+/*
+ * Call statistics for one operation.  Latencies are accounted in a log2
+ * histogram, bucket n counting calls which took [2^n, 2^(n+1)) us.
+ */
+struct regulator_op_stats {
+	unsigned long count;
+	unsigned long errors;
+	u64 total_us;
+	u64 max_us;
+	unsigned long hist[REGULATOR_STAT_BUCKETS];
+};
 
 /**
  * struct regulator_dev
@@ -37,6 +89,7 @@ static LIST_HEAD(regulator_map_list);
 struct regulator_dev {
 	struct regulator_desc *desc;
 	int use_count;
+	int num; /* N of the regulator.N class device */
 
 	/* lists we belong to */
 	struct list_head list; /* list of all regulators */
@@ -53,6 +106,74 @@ struct regulator_dev {
 	struct regulation_constraints *constraints;
 	struct regulator_dev *supply;	/* for tree */
 
+	/* supply chain resolved by set_supply(), supplies[0] being our
+	 * supply and supplies[depth - 1] the root of our tree */
+	struct regulator_dev **supplies;
+	int depth;
+
+	/* voltage range last programmed into the hardware */
+	int min_uV;
+	int max_uV;
+	unsigned long voltage_writes;
+	unsigned long voltage_writes_elided;
+
+	/* dynamic regulator mode switching */
+	struct delayed_work drms_work;
+	unsigned int drms_mode; /* mode last set, 0 if unknown */
+	unsigned long drms_mode_time; /* jiffies when drms_mode was set */
+	unsigned int drms_gen; /* cache_gen when drms_mode was set */
+	int drms_pending; /* drms_work queued and not cancelled since */
+
+	/* deferred disable - the last consumer has gone but the output and
+	 * our supply reference are kept for off_delay_ms in case it returns */
+	unsigned int off_delay_ms;
+	struct delayed_work disable_work;
+	int disable_pending;
+	unsigned long disables_deferred;
+	unsigned long disables_avoided; /* re-enabled before disable_work */
+
+	/* cached hardware state - see REGULATOR_CACHE_*.  Written under
+	 * cache_lock so readers can take a snapshot without rdev->mutex */
+	seqlock_t cache_lock;
+	unsigned int cache_gen; /* bumped when an event drops the cache */
+	unsigned int cache_valid; /* cached fields holding valid data */
+	int cache_uV;
+	int cache_uA;
+	unsigned int cache_mode;
+	int cache_enabled;
+
+	int total_uA; /* sum of consumer loads */
+
+	/* energy delivered to our consumers up to energy_time */
+	u64 energy_nJ;
+	ktime_t energy_time;
+
+	/* the output may still be ramping until settle_time */
+	ktime_t settle_time;
+
+	/* voltages available through set_voltage_sel() sorted by voltage,
+	 * volt_lo to volt_hi being those within the constraints */
+	struct regulator_voltage *voltages;
+	int n_voltages;
+	int volt_lo;
+	int volt_hi;
+
+	/* protects use_count and the enable state of atomic regulators */
+	spinlock_t atomic_lock;
+
+	/* suspend configuration last written to the hardware, the
+	 * REGULATOR_CACHE_* fields in suspend_valid are known to be current
+	 * as long as cache_gen is still suspend_gen.  rdev->mutex */
+	struct regulator_state suspend_state;
+	unsigned int suspend_valid;
+	unsigned int suspend_gen;
+
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *debugfs;
+	spinlock_t stats_lock; /* for rdev and consumer stats */
+	struct regulator_op_stats stats[REGULATOR_OP_COUNT];
+#endif
+
 	void *reg_data;		/* regulator_dev data */
 };
 
@@ -62,12 +183,70 @@ struct regulator_dev {
  * Used to provide symbolic supply names to devices.
  */
 struct regulator_map {
-	struct list_head list;
+	struct hlist_node hlist;
 	struct device *dev;
 	const char *supply;
 	struct regulator_dev *regulator;
 };
 
+/*
+ * struct regulator_voltage
+ *
+ * One voltage supported by a regulator driver using set_voltage_sel().
+ */
+struct regulator_voltage {
+	int uV;
+	unsigned int selector;
+};
+
+/*
+ * struct regulator_bulk_work
+ *
+ * Enables one group of dependent supplies for regulator_bulk_enable().
+ */
+struct regulator_bulk_work {
+	struct work_struct work;
+	struct regulator_bulk_data *consumers;
+	int num_consumers;
+	int *group;
+	int *result;
+	int id;
+	atomic_t *pending;
+	struct completion *done;
+};
+
+/*
+ * struct regulator_suspend_work
+ *
+ * Programs the suspend state of the regulators on one PMIC for
+ * regulator_suspend_prepare().
+ */
+struct regulator_suspend_work {
+	struct work_struct work;
+	struct regulator_dev **rdevs;
+	int num_rdevs;
+	int *group;
+	int id;
+	suspend_state_t state;
+	int ret;
+	atomic_t *pending;
+	struct completion *done;
+};
+
+/*
+ * struct regulator_async
+ *
+ * A consumer operation deferred to the regulator workqueue.
+ */
+struct regulator_async {
+	struct work_struct work;
+	struct regulator *regulator;
+	int min_uV;
+	int max_uV;
+	void (*complete)(struct regulator *regulator, int ret, void *data);
+	void *data;
+};
+
 /*
  * struct regulator
  *
@@ -80,19 +259,868 @@ struct regulator {
 	int min_uV;
 	int max_uV;
 	int enabled; /* client has called enabled */
+	u64 energy_nJ; /* delivered while enabled */
 	char *supply_name;
 	struct device_attribute dev_attr;
 	struct regulator_dev *rdev;
+#ifdef CONFIG_DEBUG_FS
+	struct dentry *debugfs;
+	struct regulator_op_stats stats[REGULATOR_OP_COUNT];
+#endif
 };
 
 static int _regulator_is_enabled(struct regulator_dev *rdev);
 static int _regulator_disable(struct regulator_dev *rdev);
 static int _regulator_get_voltage(struct regulator_dev *rdev);
 static int _regulator_get_current_limit(struct regulator_dev *rdev);
-static unsigned int _regulator_get_mode(struct regulator_dev *rdev);
+static int _regulator_get_mode(struct regulator_dev *rdev);
+static int _regulator_set_mode(struct regulator_dev *rdev, unsigned int mode);
 static void _notifier_call_chain(struct regulator_dev *rdev,
 				  unsigned long event, void *data);
 
+/* rdev->cache_lock held by caller */
+static void __rdev_cache_store(struct regulator_dev *rdev, unsigned int field,
+			       int val)
+{
+	switch (field) {
+	case REGULATOR_CACHE_VOLTAGE:
+		rdev->cache_uV = val;
+		break;
+	case REGULATOR_CACHE_CURRENT:
+		rdev->cache_uA = val;
+		break;
+	case REGULATOR_CACHE_MODE:
+		rdev->cache_mode = val;
+		break;
+	case REGULATOR_CACHE_STATUS:
+		rdev->cache_enabled = val;
+		break;
+	default:
+		return;
+	}
+	rdev->cache_valid |= field;
+}
+
+/* Store a value written to the hardware in the state cache if the driver
+ * allows this field to be cached. rdev->mutex held by caller, or
+ * rdev->atomic_lock for the enable state of atomic regulators.  The cache
+ * may be read from interrupt context so writers block interrupts. */
+static void rdev_cache_store(struct regulator_dev *rdev, unsigned int field,
+			     int val)
+{
+	unsigned long flags;
+
+	if (!(rdev->desc->cache_flags & field))
+		return;
+
+	write_seqlock_irqsave(&rdev->cache_lock, flags);
+	__rdev_cache_store(rdev, field, val);
+	write_sequnlock_irqrestore(&rdev->cache_lock, flags);
+}
+
+/* Store a value read back from the hardware, unless an event dropped the
+ * cache since @gen was sampled before the read. rdev->mutex held by caller */
+static void rdev_cache_fill(struct regulator_dev *rdev, unsigned int field,
+			    int val, unsigned int gen)
+{
+	unsigned long flags;
+
+	if (!(rdev->desc->cache_flags & field))
+		return;
+
+	write_seqlock_irqsave(&rdev->cache_lock, flags);
+	if (rdev->cache_gen == gen)
+		__rdev_cache_store(rdev, field, val);
+	write_sequnlock_irqrestore(&rdev->cache_lock, flags);
+}
+
+/* Forget cached hardware state, the next read will go to the hardware.
+ * rdev->mutex held by caller */
+static inline void rdev_cache_invalidate(struct regulator_dev *rdev,
+					 unsigned int fields)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&rdev->cache_lock, flags);
+	rdev->cache_valid &= ~fields;
+	write_sequnlock_irqrestore(&rdev->cache_lock, flags);
+}
+
+/* Read a cached value without taking any locks.  Returns zero if the field
+ * is not cached. */
+static int rdev_cache_read(struct regulator_dev *rdev, unsigned int field,
+			   int *val)
+{
+	unsigned seq;
+	int valid;
+
+	do {
+		seq = read_seqbegin(&rdev->cache_lock);
+
+		valid = rdev->cache_valid & field;
+		switch (field) {
+		case REGULATOR_CACHE_VOLTAGE:
+			*val = rdev->cache_uV;
+			break;
+		case REGULATOR_CACHE_CURRENT:
+			*val = rdev->cache_uA;
+			break;
+		case REGULATOR_CACHE_MODE:
+			*val = rdev->cache_mode;
+			break;
+		case REGULATOR_CACHE_STATUS:
+			*val = rdev->cache_enabled;
+			break;
+		}
+	} while (read_seqretry(&rdev->cache_lock, seq));
+
+	return valid;
+}
+
+/* Read regulator state, only taking rdev->mutex and going to the hardware
+ * if it isn't cached.  Readers of cached state never wait for writers. */
+static int rdev_read_state(struct regulator_dev *rdev, unsigned int field,
+			   int (*get)(struct regulator_dev *rdev))
+{
+	int ret;
+
+	if (rdev_cache_read(rdev, field, &ret))
+		return ret;
+
+	mutex_lock(&rdev->mutex);
+	ret = get(rdev);
+	mutex_unlock(&rdev->mutex);
+
+	return ret;
+}
+
+#ifdef CONFIG_REGULATOR_EVENTS
+/*
+ * Event device.  Records are kept in a ring shared by all readers, each of
+ * which has its own position in it.  A reader which falls more than the
+ * size of the ring behind loses the oldest records and is told how many.
+ */
+#define REGULATOR_EVENT_RING	256	/* records, a power of two */
+
+static DEFINE_SPINLOCK(regulator_event_lock);
+static DECLARE_WAIT_QUEUE_HEAD(regulator_event_wait);
+static struct regulator_event_record regulator_event_ring[REGULATOR_EVENT_RING];
+static unsigned long regulator_event_head; /* records ever logged */
+
+/* Log a record for userspace.  May be called from any context */
+static void rdev_event_log(struct regulator_dev *rdev, int type, int value)
+{
+	struct regulator_event_record *rec;
+	unsigned long flags;
+
+	spin_lock_irqsave(&regulator_event_lock, flags);
+	rec = &regulator_event_ring[regulator_event_head &
+				   (REGULATOR_EVENT_RING - 1)];
+	rec->timestamp = ktime_to_ns(ktime_get());
+	rec->regulator = rdev->num;
+	rec->type = type;
+	rec->lost = 0;
+	rec->value = value;
+	rec->reserved = 0;
+	regulator_event_head++;
+	spin_unlock_irqrestore(&regulator_event_lock, flags);
+
+	wake_up_interruptible(&regulator_event_wait);
+}
+#else
+static inline void rdev_event_log(struct regulator_dev *rdev, int type,
+				  int value)
+{
+}
+#endif
+
+/* Account a change in a consumer's load. rdev->mutex held by caller */
+static void regulator_set_load(struct regulator *regulator, int uA_load)
+{
+	regulator->rdev->total_uA += uA_load - regulator->uA_load;
+	regulator->uA_load = uA_load;
+}
+
+/*
+ * Energy accounting.  Each enabled consumer is charged for its requested
+ * load at the output voltage for the time since the last update, which is
+ * made before any of these change.  Only state already held in memory is
+ * used so accounting never touches the hardware.  Changes made with the
+ * atomic API are only seen at the next update.
+ */
+
+/* Output voltage for accounting, zero if it is not known without asking
+ * the hardware */
+static int rdev_energy_uV(struct regulator_dev *rdev)
+{
+	struct regulation_constraints *c = rdev->constraints;
+	int uV;
+
+	if (rdev_cache_read(rdev, REGULATOR_CACHE_VOLTAGE, &uV))
+		return uV;
+	if (rdev->min_uV)
+		return rdev->min_uV;
+	if (c && c->min_uV == c->max_uV)
+		return c->min_uV;
+	return 0;
+}
+
+/* rdev->mutex held by caller */
+static void regulator_energy_update(struct regulator_dev *rdev)
+{
+	struct regulator *consumer;
+	ktime_t now = ktime_get();
+	s64 us;
+	u64 nJ;
+	int uV;
+
+	us = ktime_to_us(ktime_sub(now, rdev->energy_time));
+	rdev->energy_time = now;
+
+	uV = rdev_energy_uV(rdev);
+	if (uV <= 0 || us <= 0)
+		return;
+
+	list_for_each_entry(consumer, &rdev->consumer_list, list) {
+		if (!consumer->enabled || consumer->uA_load <= 0)
+			continue;
+
+		/* uA * uV / 10^6 is uW, uW * us / 10^3 is nJ */
+		nJ = div_u64((u64)consumer->uA_load * uV, 1000000);
+		nJ = div_u64(nJ * us, 1000);
+		consumer->energy_nJ += nJ;
+		rdev->energy_nJ += nJ;
+	}
+}
+
+/* Energy delivered to regulator, or to all the consumers of rdev if it is
+ * NULL, in uJ */
+static u64 regulator_energy_uJ(struct regulator_dev *rdev,
+			       struct regulator *regulator)
+{
+	u64 nJ;
+
+	mutex_lock(&rdev->mutex);
+	regulator_energy_update(rdev);
+	nJ = regulator ? regulator->energy_nJ : rdev->energy_nJ;
+	mutex_unlock(&rdev->mutex);
+
+	return div_u64(nJ, 1000);
+}
+
+static const char *rdev_get_name(struct regulator_dev *rdev)
+{
+	if (rdev->constraints && rdev->constraints->name)
+		return rdev->constraints->name;
+	else if (rdev->desc->name)
+		return rdev->desc->name;
+	else
+		return "";
+}
+
+#ifdef CONFIG_DEBUG_FS
+static struct dentry *regulator_debugfs_root;
+
+static const char *regulator_op_names[REGULATOR_OP_COUNT] = {
+	[REGULATOR_OP_ENABLE] = "enable",
+	[REGULATOR_OP_DISABLE] = "disable",
+	[REGULATOR_OP_SET_VOLTAGE] = "set_voltage",
+	[REGULATOR_OP_GET_VOLTAGE] = "get_voltage",
+	[REGULATOR_OP_SET_MODE] = "set_mode",
+	[REGULATOR_OP_SET_OPTIMUM_MODE] = "set_optimum_mode",
+};
+
+static void regulator_stats_add(struct regulator_dev *rdev,
+				struct regulator_op_stats *stats,
+				s64 us, int ret)
+{
+	int bucket = us > 0 ? fls64(us) - 1 : 0;
+	unsigned long flags;
+
+	if (bucket >= REGULATOR_STAT_BUCKETS)
+		bucket = REGULATOR_STAT_BUCKETS - 1;
+
+	spin_lock_irqsave(&rdev->stats_lock, flags);
+	stats->count++;
+	if (ret < 0)
+		stats->errors++;
+	stats->total_us += us;
+	if (us > stats->max_us)
+		stats->max_us = us;
+	stats->hist[bucket]++;
+	spin_unlock_irqrestore(&rdev->stats_lock, flags);
+}
+
+/* Account a consumer API call started at @start */
+static void regulator_op_account(struct regulator *regulator, int op,
+				 ktime_t start, int ret)
+{
+	regulator_stats_add(regulator->rdev, &regulator->stats[op],
+			    ktime_to_us(ktime_sub(ktime_get(), start)), ret);
+}
+
+static void regulator_stats_show(struct seq_file *s,
+				 struct regulator_dev *rdev,
+				 struct regulator_op_stats *stats)
+{
+	int op, i;
+
+	spin_lock_irq(&rdev->stats_lock);
+	for (op = 0; op < REGULATOR_OP_COUNT; op++) {
+		if (!stats[op].count)
+			continue;
+
+		seq_printf(s, "%s: count %lu errors %lu avg_us %llu max_us %llu\n",
+			   regulator_op_names[op], stats[op].count,
+			   stats[op].errors,
+			   div_u64(stats[op].total_us, stats[op].count),
+			   stats[op].max_us);
+
+		seq_printf(s, "  latency_us:");
+		for (i = 0; i < REGULATOR_STAT_BUCKETS; i++)
+			if (stats[op].hist[i])
+				seq_printf(s, " %lu:%lu", i ? 1UL << i : 0,
+					   stats[op].hist[i]);
+		seq_printf(s, "\n");
+	}
+	spin_unlock_irq(&rdev->stats_lock);
+}
+
+static int regulator_stats_seq_show(struct seq_file *s, void *unused)
+{
+	struct regulator_dev *rdev = s->private;
+
+	regulator_stats_show(s, rdev, rdev->stats);
+	return 0;
+}
+
+static int regulator_stats_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, regulator_stats_seq_show, inode->i_private);
+}
+
+static const struct file_operations regulator_stats_fops = {
+	.open = regulator_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int regulator_consumer_stats_seq_show(struct seq_file *s, void *unused)
+{
+	struct regulator *regulator = s->private;
+
+	seq_printf(s, "enabled: %d\nload_uA: %d\n", regulator->enabled,
+		   regulator->uA_load);
+	if (regulator->max_uV)
+		seq_printf(s, "voltage_uV: %d-%d\n", regulator->min_uV,
+			   regulator->max_uV);
+	seq_printf(s, "energy_uJ: %llu\n",
+		   regulator_energy_uJ(regulator->rdev, regulator));
+	regulator_stats_show(s, regulator->rdev, regulator->stats);
+	return 0;
+}
+
+static int regulator_consumer_stats_open(struct inode *inode,
+					 struct file *file)
+{
+	return single_open(file, regulator_consumer_stats_seq_show,
+			   inode->i_private);
+}
+
+static const struct file_operations regulator_consumer_stats_fops = {
+	.open = regulator_consumer_stats_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release,
+};
+
+static int regulator_reset_open(struct inode *inode, struct file *file)
+{
+	file->private_data = inode->i_private;
+	return 0;
+}
+
+/* Any write clears the statistics of the regulator and its consumers */
+static ssize_t regulator_reset_write(struct file *file,
+				     const char __user *user_buf,
+				     size_t count, loff_t *ppos)
+{
+	struct regulator_dev *rdev = file->private_data;
+	struct regulator *regulator;
+
+	mutex_lock(&rdev->mutex);
+	spin_lock_irq(&rdev->stats_lock);
+	memset(rdev->stats, 0, sizeof(rdev->stats));
+	list_for_each_entry(regulator, &rdev->consumer_list, list)
+		memset(regulator->stats, 0, sizeof(regulator->stats));
+	spin_unlock_irq(&rdev->stats_lock);
+	mutex_unlock(&rdev->mutex);
+
+	return count;
+}
+
+static const struct file_operations regulator_reset_fops = {
+	.open = regulator_reset_open,
+	.write = regulator_reset_write,
+};
+
+static void rdev_init_debugfs(struct regulator_dev *rdev)
+{
+	spin_lock_init(&rdev->stats_lock);
+
+	if (!regulator_debugfs_root)
+		return;
+
+	rdev->debugfs = debugfs_create_dir(dev_name(&rdev->dev),
+					   regulator_debugfs_root);
+	if (IS_ERR(rdev->debugfs) || !rdev->debugfs) {
+		printk(KERN_WARNING "%s: failed to create debugfs for %s\n",
+		       __func__, rdev_get_name(rdev));
+		rdev->debugfs = NULL;
+		return;
+	}
+
+	debugfs_create_file("stats", 0444, rdev->debugfs, rdev,
+			    &regulator_stats_fops);
+	debugfs_create_file("reset", 0200, rdev->debugfs, rdev,
+			    &regulator_reset_fops);
+}
+
+static void rdev_exit_debugfs(struct regulator_dev *rdev)
+{
+	debugfs_remove_recursive(rdev->debugfs);
+}
+
+static void regulator_init_debugfs(struct regulator *regulator)
+{
+	if (regulator->rdev->debugfs && regulator->supply_name)
+		regulator->debugfs = debugfs_create_file(regulator->supply_name,
+				0444, regulator->rdev->debugfs, regulator,
+				&regulator_consumer_stats_fops);
+}
+
+static void regulator_exit_debugfs(struct regulator *regulator)
+{
+	debugfs_remove(regulator->debugfs);
+}
+
+static void regulator_debugfs_init(void)
+{
+	regulator_debugfs_root = debugfs_create_dir("regulator", NULL);
+	if (IS_ERR(regulator_debugfs_root) || !regulator_debugfs_root) {
+		printk(KERN_WARNING "regulator: failed to create debugfs\n");
+		regulator_debugfs_root = NULL;
+	}
+}
+#else
+static inline void regulator_op_account(struct regulator *regulator, int op,
+					ktime_t start, int ret)
+{
+}
+
+static inline void rdev_init_debugfs(struct regulator_dev *rdev)
+{
+}
+
+static inline void rdev_exit_debugfs(struct regulator_dev *rdev)
+{
+}
+
+static inline void regulator_init_debugfs(struct regulator *regulator)
+{
+}
+
+static inline void regulator_exit_debugfs(struct regulator *regulator)
+{
+}
+
+static inline void regulator_debugfs_init(void)
+{
+}
+#endif
+
+/* Call immediately before a driver operation, returns the start time to
+ * pass to rdev_op_end() */
+static ktime_t rdev_op_begin(struct regulator_dev *rdev, int op)
+{
+	trace_regulator_op_start(rdev_get_name(rdev), op);
+	return ktime_get();
+}
+
+/* Trace and account a driver operation which returned @ret */
+static void rdev_op_end(struct regulator_dev *rdev, int op, ktime_t start,
+			int ret)
+{
+	s64 us = ktime_to_us(ktime_sub(ktime_get(), start));
+
+	trace_regulator_op_end(rdev_get_name(rdev), op, ret, us);
+#ifdef CONFIG_DEBUG_FS
+	regulator_stats_add(rdev, &rdev->stats[op], us, ret);
+#endif
+}
+
+/* Wait for a regulator output to settle, sleeping unless the wait is too
+ * short to be worth scheduling for. */
+static void regulator_settle(int delay_us)
+{
+	ktime_t expires;
+
+	if (delay_us <= 0)
+		return;
+
+	if (delay_us < REGULATOR_SETTLE_SPIN_US) {
+		udelay(delay_us);
+		return;
+	}
+
+	expires = ktime_set(delay_us / USEC_PER_SEC,
+			    (delay_us % USEC_PER_SEC) * NSEC_PER_USEC);
+	set_current_state(TASK_UNINTERRUPTIBLE);
+	schedule_hrtimeout(&expires, HRTIMER_MODE_REL);
+}
+
+/* Note that the output won't be stable for another delay_us.  Nobody waits
+ * with rdev->mutex held, instead each caller which needs the output stable
+ * takes rdev_settle_remaining() and waits once it has dropped the lock.
+ * rdev->mutex held by caller */
+static void rdev_settle_after(struct regulator_dev *rdev, int delay_us)
+{
+	ktime_t t;
+
+	if (delay_us <= 0)
+		return;
+
+	t = ktime_add_us(ktime_get(), delay_us);
+	if (ktime_us_delta(t, rdev->settle_time) > 0)
+		rdev->settle_time = t;
+}
+
+/* rdev->mutex held by caller */
+static int rdev_settle_remaining(struct regulator_dev *rdev)
+{
+	s64 us = ktime_us_delta(rdev->settle_time, ktime_get());
+
+	return us > 0 ? us : 0;
+}
+
+/* time in us for the output to settle after enable */
+static int _regulator_enable_time(struct regulator_dev *rdev)
+{
+	if (rdev->desc->ops->enable_time)
+		return rdev->desc->ops->enable_time(rdev);
+	return rdev->desc->enable_time;
+}
+
+/* time in us for the output to settle after a voltage change */
+static int _regulator_set_voltage_time(struct regulator_dev *rdev,
+				       int old_uV, int new_uV)
+{
+	if (old_uV < 0 || new_uV < 0)
+		return 0;
+	if (rdev->desc->ops->set_voltage_time)
+		return rdev->desc->ops->set_voltage_time(rdev, old_uV, new_uV);
+	if (!rdev->desc->ramp_delay)
+		return 0;
+	return DIV_ROUND_UP(abs(new_uV - old_uV), rdev->desc->ramp_delay);
+}
+
+static inline int rdev_can_set_voltage(struct regulator_dev *rdev)
+{
+	return rdev->desc->ops->set_voltage || rdev->desc->ops->set_voltage_sel;
+}
+
+static inline int rdev_can_get_voltage(struct regulator_dev *rdev)
+{
+	return rdev->desc->ops->get_voltage || rdev->desc->ops->get_voltage_sel;
+}
+
+/* the voltage of a driver selector, zero or an error if unsupported */
+static int _regulator_list_voltage(struct regulator_dev *rdev,
+				   unsigned int selector)
+{
+	struct regulator_desc *desc = rdev->desc;
+	const struct regulator_linear_range *range;
+	int i;
+
+	if (selector >= desc->n_voltages)
+		return -EINVAL;
+	if (desc->ops->list_voltage)
+		return desc->ops->list_voltage(rdev, selector);
+	if (desc->volt_table)
+		return desc->volt_table[selector];
+
+	for (i = 0; i < desc->n_linear_ranges; i++) {
+		range = &desc->linear_ranges[i];
+		if (selector >= range->min_sel && selector <= range->max_sel)
+			return range->min_uV +
+				(selector - range->min_sel) * range->uV_step;
+	}
+
+	return -EINVAL;
+}
+
+/* index of the lowest voltage in rdev->voltages no less than min_uV */
+static int regulator_find_voltage(struct regulator_dev *rdev, int min_uV)
+{
+	int lo = 0, hi = rdev->n_voltages, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (rdev->voltages[mid].uV < min_uV)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/**
+ * regulator_map_voltage - find the selector for a voltage range
+ * @rdev: regulator
+ * @min_uV: Minimum required voltage in uV
+ * @max_uV: Maximum acceptable voltage in uV
+ *
+ * Returns the driver selector for the lowest voltage supported by the
+ * regulator within the range, or -EINVAL if there is none.  For drivers
+ * implementing set_voltage_sel().
+ */
+int regulator_map_voltage(struct regulator_dev *rdev, int min_uV, int max_uV)
+{
+	int i = regulator_find_voltage(rdev, min_uV);
+
+	if (i >= rdev->n_voltages || rdev->voltages[i].uV > max_uV)
+		return -EINVAL;
+
+	return rdev->voltages[i].selector;
+}
+EXPORT_SYMBOL_GPL(regulator_map_voltage);
+
+static int regulator_voltage_cmp(const void *a, const void *b)
+{
+	const struct regulator_voltage *va = a, *vb = b;
+
+	if (va->uV != vb->uV)
+		return va->uV < vb->uV ? -1 : 1;
+	return va->selector < vb->selector ? -1 : va->selector > vb->selector;
+}
+
+/* Build the sorted table of the voltages the driver can select and check
+ * the constraints allow at least one of them, so requests can be mapped
+ * with a binary search. */
+static int regulator_init_voltages(struct regulator_dev *rdev)
+{
+	struct regulation_constraints *constraints = rdev->constraints;
+	struct regulator_voltage *voltages;
+	unsigned int sel;
+	int i, j, n = 0, uV;
+
+	if (!rdev->desc->ops->set_voltage_sel)
+		return 0;
+
+	voltages = kcalloc(rdev->desc->n_voltages, sizeof(*voltages),
+			   GFP_KERNEL);
+	if (!voltages)
+		return -ENOMEM;
+
+	for (sel = 0; sel < rdev->desc->n_voltages; sel++) {
+		uV = _regulator_list_voltage(rdev, sel);
+		if (uV <= 0)
+			continue;
+		voltages[n].uV = uV;
+		voltages[n].selector = sel;
+		n++;
+	}
+
+	sort(voltages, n, sizeof(*voltages), regulator_voltage_cmp, NULL);
+
+	/* several selectors may give the same voltage, use the lowest */
+	for (i = 1, j = 0; i < n; i++)
+		if (voltages[i].uV != voltages[j].uV)
+			voltages[++j] = voltages[i];
+	if (n)
+		n = j + 1;
+
+	rdev->voltages = voltages;
+	rdev->n_voltages = n;
+
+	rdev->volt_lo = 0;
+	rdev->volt_hi = n - 1;
+	if (constraints->max_uV) {
+		rdev->volt_lo = regulator_find_voltage(rdev,
+						       constraints->min_uV);
+		rdev->volt_hi = regulator_find_voltage(rdev,
+						       constraints->max_uV + 1) - 1;
+	}
+
+	if (rdev->volt_lo > rdev->volt_hi) {
+		printk(KERN_ERR "%s: %s supports no voltage in %d-%duV\n",
+		       __func__, rdev->desc->name, constraints->min_uV,
+		       constraints->max_uV);
+		kfree(voltages);
+		rdev->voltages = NULL;
+		rdev->n_voltages = 0;
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* Set the voltage in the driver, mapping the range to a selector for
+ * drivers which want one.  rdev->mutex held by caller */
+static int _regulator_do_set_voltage(struct regulator_dev *rdev,
+				     int min_uV, int max_uV)
+{
+	int sel, ret;
+
+	if (rdev->desc->ops->set_voltage) {
+		ret = rdev->desc->ops->set_voltage(rdev, min_uV, max_uV);
+		if (ret == 0)
+			rdev_event_log(rdev, REGULATOR_RECORD_VOLTAGE, min_uV);
+		return ret;
+	}
+
+	sel = regulator_map_voltage(rdev, min_uV, max_uV);
+	if (sel < 0)
+		return sel;
+
+	ret = rdev->desc->ops->set_voltage_sel(rdev, sel);
+	if (ret < 0)
+		return ret;
+
+	/* we know exactly what the hardware will give us */
+	ret = _regulator_list_voltage(rdev, sel);
+	rdev_cache_store(rdev, REGULATOR_CACHE_VOLTAGE, ret);
+	rdev_event_log(rdev, REGULATOR_RECORD_VOLTAGE, ret);
+	return 0;
+}
+
+/* Work out the voltage range acceptable to every enabled consumer and to
+ * @regulator, which need not be enabled yet.  Returns the number of
+ * consumers with a voltage request. rdev->mutex held by caller */
+static int regulator_aggregate_voltage(struct regulator_dev *rdev,
+				       struct regulator *regulator,
+				       int *min_uV, int *max_uV)
+{
+	struct regulator *consumer;
+	int count = 0;
+
+	list_for_each_entry(consumer, &rdev->consumer_list, list) {
+		/* consumers who never asked for a voltage don't care */
+		if (!consumer->max_uV)
+			continue;
+		if (!consumer->enabled && consumer != regulator)
+			continue;
+
+		if (!count || consumer->min_uV > *min_uV)
+			*min_uV = consumer->min_uV;
+		if (!count || consumer->max_uV < *max_uV)
+			*max_uV = consumer->max_uV;
+		count++;
+	}
+
+	if (count && *min_uV > *max_uV)
+		return -EINVAL;
+
+	return count;
+}
+
+/* Program the lowest voltage satisfying all consumers, unless the hardware
+ * is already known to be delivering it.  Returns the time in us the caller
+ * should wait for the output to settle. rdev->mutex held by caller */
+static int regulator_update_voltage(struct regulator_dev *rdev,
+				    struct regulator *regulator)
+{
+	int ret, min_uV = 0, max_uV = 0, cur_uV, old_uV = -EINVAL;
+	ktime_t start;
+
+	if (!rdev_can_set_voltage(rdev))
+		return 0;
+
+	ret = regulator_aggregate_voltage(rdev, regulator, &min_uV, &max_uV);
+	if (ret < 0) {
+		printk(KERN_ERR "%s: conflicting voltage requests for %s\n",
+		       __func__, rdev->desc->name);
+		return ret;
+	}
+	if (ret == 0)
+		return 0;
+
+	if (min_uV == rdev->min_uV && max_uV == rdev->max_uV) {
+		rdev->voltage_writes_elided++;
+		return 0;
+	}
+
+	/* Drivers select the lowest voltage no less than min_uV so if the
+	 * current voltage is still in range and min_uV hasn't dropped then
+	 * the driver would pick the same voltage again. */
+	if (rdev->max_uV && min_uV >= rdev->min_uV &&
+	    rdev_cache_read(rdev, REGULATOR_CACHE_VOLTAGE, &cur_uV) &&
+	    cur_uV >= min_uV && cur_uV <= max_uV) {
+		rdev->min_uV = min_uV;
+		rdev->max_uV = max_uV;
+		rdev->voltage_writes_elided++;
+		return 0;
+	}
+
+	/* we only need the old voltage to work out how long to ramp for */
+	if (rdev->desc->ramp_delay || rdev->desc->ops->set_voltage_time)
+		old_uV = _regulator_get_voltage(rdev);
+
+	/* charge for the old voltage while we still know it */
+	regulator_energy_update(rdev);
+
+	/* the driver picks the actual voltage within the range so read it
+	 * back from the hardware next time it is asked for */
+	rdev_cache_invalidate(rdev, REGULATOR_CACHE_VOLTAGE);
+
+	start = rdev_op_begin(rdev, REGULATOR_OP_SET_VOLTAGE);
+	ret = _regulator_do_set_voltage(rdev, min_uV, max_uV);
+	rdev_op_end(rdev, REGULATOR_OP_SET_VOLTAGE, start, ret);
+	rdev->voltage_writes++;
+
+	if (ret < 0) {
+		/* we don't know what state the hardware was left in */
+		rdev->min_uV = 0;
+		rdev->max_uV = 0;
+		return ret;
+	}
+	rdev->min_uV = min_uV;
+	rdev->max_uV = max_uV;
+
+	/* only an enabled output has to reach the new voltage */
+	if (old_uV >= 0 && (rdev->use_count || rdev->constraints->always_on))
+		return _regulator_set_voltage_time(rdev, old_uV,
+						   _regulator_get_voltage(rdev));
+
+	return 0;
+}
+
+static struct hlist_head *regulator_map_bucket(struct device *dev,
+					       const char *supply)
+{
+	u32 hash = jhash(supply, strlen(supply), (u32)(unsigned long)dev);
+
+	return &regulator_map_hash[hash & (REGULATOR_MAP_HASH_SIZE - 1)];
+}
+
+/* find the regulator mapped to a consumer supply.
+ * regulator_map_sem held by caller */
+static struct regulator_dev *regulator_map_lookup(struct device *dev,
+						  const char *supply)
+{
+	struct regulator_map *map;
+	struct hlist_node *pos;
+
+	hlist_for_each_entry(map, pos, regulator_map_bucket(dev, supply),
+			     hlist) {
+		if (dev == map->dev && strcmp(map->supply, supply) == 0)
+			return map->regulator;
+	}
+	return NULL;
+}
+
 /* gets the regulator for a given consumer device */
 static struct regulator *get_device_regulator(struct device *dev)
 {
@@ -224,13 +1252,9 @@ static ssize_t regulator_uV_show(struct device *dev,
 				struct device_attribute *attr, char *buf)
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
-	ssize_t ret;
-
-	mutex_lock(&rdev->mutex);
-	ret = sprintf(buf, "%d\n", _regulator_get_voltage(rdev));
-	mutex_unlock(&rdev->mutex);
 
-	return ret;
+	return sprintf(buf, "%d\n", rdev_read_state(rdev,
+			REGULATOR_CACHE_VOLTAGE, _regulator_get_voltage));
 }
 
 static ssize_t regulator_uA_show(struct device *dev,
@@ -238,30 +1262,24 @@ static ssize_t regulator_uA_show(struct device *dev,
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
 
-	return sprintf(buf, "%d\n", _regulator_get_current_limit(rdev));
+	return sprintf(buf, "%d\n", rdev_read_state(rdev,
+			REGULATOR_CACHE_CURRENT, _regulator_get_current_limit));
 }
 
 static ssize_t regulator_name_show(struct device *dev,
 			     struct device_attribute *attr, char *buf)
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
-	const char *name;
 
-	if (rdev->constraints->name)
-		name = rdev->constraints->name;
-	else if (rdev->desc->name)
-		name = rdev->desc->name;
-	else
-		name = "";
-
-	return sprintf(buf, "%s\n", name);
+	return sprintf(buf, "%s\n", rdev_get_name(rdev));
 }
 
 static ssize_t regulator_opmode_show(struct device *dev,
 				    struct device_attribute *attr, char *buf)
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
-	int mode = _regulator_get_mode(rdev);
+	int mode = rdev_read_state(rdev, REGULATOR_CACHE_MODE,
+				   _regulator_get_mode);
 
 	switch (mode) {
 	case REGULATOR_MODE_FAST:
@@ -280,7 +1298,8 @@ static ssize_t regulator_state_show(struct device *dev,
 				   struct device_attribute *attr, char *buf)
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
-	int state = _regulator_is_enabled(rdev);
+	int state = rdev_read_state(rdev, REGULATOR_CACHE_STATUS,
+				    _regulator_is_enabled);
 
 	if (state > 0)
 		return sprintf(buf, "enabled\n");
@@ -338,14 +1357,66 @@ static ssize_t regulator_total_uA_show(struct device *dev,
 				      struct device_attribute *attr, char *buf)
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
-	struct regulator *regulator;
-	int uA = 0;
+
+	return sprintf(buf, "%d\n", rdev->total_uA);
+}
+
+static ssize_t regulator_voltage_writes_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	return sprintf(buf, "%lu\n", rdev->voltage_writes);
+}
+
+static ssize_t regulator_voltage_writes_elided_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	return sprintf(buf, "%lu\n", rdev->voltage_writes_elided);
+}
+
+static ssize_t regulator_off_delay_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	return sprintf(buf, "%u\n", rdev->off_delay_ms);
+}
+
+static ssize_t regulator_off_delay_store(struct device *dev,
+	struct device_attribute *attr, const char *buf, size_t count)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	unsigned long val;
+
+	if (strict_strtoul(buf, 10, &val) || val > UINT_MAX)
+		return -EINVAL;
 
 	mutex_lock(&rdev->mutex);
-	list_for_each_entry(regulator, &rdev->consumer_list, list)
-	    uA += regulator->uA_load;
+	rdev->off_delay_ms = val;
 	mutex_unlock(&rdev->mutex);
-	return sprintf(buf, "%d\n", uA);
+
+	return count;
+}
+
+static ssize_t regulator_disables_deferred_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	return sprintf(buf, "%lu\n", rdev->disables_deferred);
+}
+
+static ssize_t regulator_disables_avoided_show(struct device *dev,
+				      struct device_attribute *attr, char *buf)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	return sprintf(buf, "%lu\n", rdev->disables_avoided);
+}
+
+static ssize_t regulator_energy_show(struct device *dev,
+				     struct device_attribute *attr, char *buf)
+{
+	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	return sprintf(buf, "%llu\n", regulator_energy_uJ(rdev, NULL));
 }
 
 static ssize_t regulator_num_users_show(struct device *dev,
@@ -501,7 +1572,15 @@ static struct device_attribute regulator_dev_attrs[] = {
 	__ATTR(max_microvolts, 0444, regulator_max_uV_show, NULL),
 	__ATTR(max_microamps, 0444, regulator_max_uA_show, NULL),
 	__ATTR(requested_microamps, 0444, regulator_total_uA_show, NULL),
+	__ATTR(microjoules, 0444, regulator_energy_show, NULL),
 	__ATTR(num_users, 0444, regulator_num_users_show, NULL),
+	__ATTR(off_delay_ms, 0644, regulator_off_delay_show,
+		regulator_off_delay_store),
+	__ATTR(disables_deferred, 0444, regulator_disables_deferred_show, NULL),
+	__ATTR(disables_avoided, 0444, regulator_disables_avoided_show, NULL),
+	__ATTR(voltage_writes, 0444, regulator_voltage_writes_show, NULL),
+	__ATTR(voltage_writes_elided, 0444,
+		regulator_voltage_writes_elided_show, NULL),
 	__ATTR(type, 0444, regulator_type_show, NULL),
 	__ATTR(suspend_mem_microvolts, 0444,
 		regulator_suspend_mem_uV_show, NULL),
@@ -527,6 +1606,8 @@ static struct device_attribute regulator_dev_attrs[] = {
 static void regulator_dev_release(struct device *dev)
 {
 	struct regulator_dev *rdev = dev_get_drvdata(dev);
+	kfree(rdev->supplies);
+	kfree(rdev->voltages);
 	kfree(rdev);
 }
 
@@ -536,35 +1617,31 @@ static struct class regulator_class = {
 	.dev_attrs = regulator_dev_attrs,
 };
 
-/* Calculate the new optimum regulator operating mode based on the new total
- * consumer load. All locks held by caller */
-static void drms_uA_update(struct regulator_dev *rdev)
+/* Work out the optimum operating mode for the total consumer load plus
+ * extra_uA. rdev->mutex held by caller */
+static int drms_get_optimum_mode(struct regulator_dev *rdev, int extra_uA)
 {
-	struct regulator *sibling;
-	int current_uA = 0, output_uV, input_uV, err;
+	int current_uA, output_uV, input_uV, err;
 	unsigned int mode;
 
-	err = regulator_check_drms(rdev);
-	if (err < 0 || !rdev->desc->ops->get_optimum_mode ||
-	    !rdev->desc->ops->get_voltage || !rdev->desc->ops->set_mode);
-	return;
+	if (!rdev->desc->ops->get_optimum_mode ||
+	    !rdev_can_get_voltage(rdev) || !rdev->desc->ops->set_mode)
+		return -EINVAL;
 
 	/* get output voltage */
-	output_uV = rdev->desc->ops->get_voltage(rdev);
+	output_uV = _regulator_get_voltage(rdev);
 	if (output_uV <= 0)
-		return;
+		return -EINVAL;
 
 	/* get input voltage */
-	if (rdev->supply && rdev->supply->desc->ops->get_voltage)
-		input_uV = rdev->supply->desc->ops->get_voltage(rdev->supply);
+	if (rdev->supply && rdev_can_get_voltage(rdev->supply))
+		input_uV = _regulator_get_voltage(rdev->supply);
 	else
 		input_uV = rdev->constraints->input_uV;
 	if (input_uV <= 0)
-		return;
+		return -EINVAL;
 
-	/* calc total requested load */
-	list_for_each_entry(sibling, &rdev->consumer_list, list)
-	    current_uA += sibling->uA_load;
+	current_uA = rdev->total_uA + extra_uA;
 
 	/* now get the optimum mode for our new total regulator load */
 	mode = rdev->desc->ops->get_optimum_mode(rdev, input_uV,
@@ -572,13 +1649,125 @@ static void drms_uA_update(struct regulator_dev *rdev)
 
 	/* check the new mode is allowed */
 	err = regulator_check_mode(rdev, mode);
-	if (err == 0)
-		rdev->desc->ops->set_mode(rdev, mode);
+	if (err < 0)
+		return err;
+
+	return mode;
+}
+
+/* The mode last written, or 0 if it is unknown or an event may have
+ * changed it since. rdev->mutex held by caller */
+static unsigned int drms_current_mode(struct regulator_dev *rdev)
+{
+	if (rdev->drms_gen != rdev->cache_gen)
+		return 0;
+	return rdev->drms_mode;
+}
+
+/* rdev->mutex held by caller */
+static int drms_set_mode(struct regulator_dev *rdev, unsigned int mode)
+{
+	if (mode == drms_current_mode(rdev))
+		return 0;
+
+	return _regulator_set_mode(rdev, mode);
+}
+
+/*
+ * Deferred DRMS re-evaluation.  Only moves to more efficient modes are
+ * deferred: they have to hold with drms_hysteresis_uA of extra load and
+ * the regulator has to have spent drms_residency_ms in its current mode.
+ */
+static void drms_work(struct work_struct *work)
+{
+	struct regulator_dev *rdev =
+		container_of(work, struct regulator_dev, drms_work.work);
+	struct regulation_constraints *constraints = rdev->constraints;
+	unsigned long residency;
+	unsigned int cur;
+	int mode;
+
+	mutex_lock(&rdev->mutex);
+
+	/* cancelled while we were waiting for the lock */
+	if (!rdev->drms_pending)
+		goto out;
+	rdev->drms_pending = 0;
+
+	cur = drms_current_mode(rdev);
+	mode = drms_get_optimum_mode(rdev, constraints->drms_hysteresis_uA);
+	if (mode <= 0 || mode == cur)
+		goto out;
+
+	/* modes with lower values are more capable, go there now */
+	if (!cur || mode < cur) {
+		drms_set_mode(rdev, mode);
+		goto out;
+	}
+
+	residency = rdev->drms_mode_time +
+		msecs_to_jiffies(constraints->drms_residency_ms);
+	if (time_before(jiffies, residency)) {
+		rdev->drms_pending = 1;
+		queue_delayed_work(regulator_wq, &rdev->drms_work,
+				   residency - jiffies);
+		goto out;
+	}
+
+	drms_set_mode(rdev, mode);
+out:
+	mutex_unlock(&rdev->mutex);
 }
 
+/* Drop any pending deferred DRMS update, including one already waiting
+ * for rdev->mutex.  rdev->mutex held by caller */
+static void drms_cancel(struct regulator_dev *rdev)
+{
+	rdev->drms_pending = 0;
+	cancel_delayed_work(&rdev->drms_work);
+}
+
+/* Calculate the new optimum regulator operating mode based on the new total
+ * consumer load.  Changes to a more capable mode are applied immediately
+ * but, if the constraints ask for it, changes to more efficient modes are
+ * batched up and applied later by drms_work().  Returns the optimum mode.
+ * All locks held by caller */
+static int drms_uA_update(struct regulator_dev *rdev)
+{
+	unsigned int cur;
+	int mode, ret;
+
+	ret = regulator_check_drms(rdev);
+	if (ret < 0)
+		return ret;
+
+	mode = drms_get_optimum_mode(rdev, 0);
+	if (mode <= 0)
+		return mode;
+
+	cur = drms_current_mode(rdev);
+	if (!rdev->constraints->drms_delay_ms || !cur || mode < cur) {
+		drms_cancel(rdev);
+		ret = drms_set_mode(rdev, mode);
+		if (ret < 0)
+			return ret;
+	} else if (mode != cur) {
+		/* does nothing if already pending, batching the updates */
+		rdev->drms_pending = 1;
+		queue_delayed_work(regulator_wq, &rdev->drms_work,
+			msecs_to_jiffies(rdev->constraints->drms_delay_ms));
+	}
+
+	return mode;
+}
+
+/* Only program the parts of the suspend state which differ from what was
+ * last written, the configuration rarely changes between suspends.
+ * rdev->mutex held by caller */
 static int suspend_set_state(struct regulator_dev *rdev,
 	struct regulator_state *rstate)
 {
+	struct regulator_state *cur = &rdev->suspend_state;
 	int ret = 0;
 
 	/* enable & disable are mandatory for suspend control */
@@ -589,30 +1778,53 @@ static int suspend_set_state(struct regulator_dev *rdev,
 		return -EINVAL;
 	}
 
-	if (rstate->enabled)
-		ret = rdev->desc->ops->set_suspend_enable(rdev);
-	else
-		ret = rdev->desc->ops->set_suspend_disable(rdev);
-	if (ret < 0) {
-		printk(KERN_ERR "%s: failed to enabled/disable\n", __func__);
-		return ret;
+	/* an event since the last write may have reset the hardware */
+	if (rdev->suspend_gen != rdev->cache_gen) {
+		rdev->suspend_valid = 0;
+		rdev->suspend_gen = rdev->cache_gen;
+	}
+
+	if (!(rdev->suspend_valid & REGULATOR_CACHE_STATUS) ||
+	    cur->enabled != rstate->enabled) {
+		rdev->suspend_valid &= ~REGULATOR_CACHE_STATUS;
+		if (rstate->enabled)
+			ret = rdev->desc->ops->set_suspend_enable(rdev);
+		else
+			ret = rdev->desc->ops->set_suspend_disable(rdev);
+		if (ret < 0) {
+			printk(KERN_ERR "%s: failed to enabled/disable\n",
+				__func__);
+			return ret;
+		}
+		cur->enabled = rstate->enabled;
+		rdev->suspend_valid |= REGULATOR_CACHE_STATUS;
 	}
 
-	if (rdev->desc->ops->set_suspend_voltage && rstate->uV > 0) {
+	if (rdev->desc->ops->set_suspend_voltage && rstate->uV > 0 &&
+	    (!(rdev->suspend_valid & REGULATOR_CACHE_VOLTAGE) ||
+	     cur->uV != rstate->uV)) {
+		rdev->suspend_valid &= ~REGULATOR_CACHE_VOLTAGE;
 		ret = rdev->desc->ops->set_suspend_voltage(rdev, rstate->uV);
 		if (ret < 0) {
 			printk(KERN_ERR "%s: failed to set voltage\n",
 				__func__);
 			return ret;
 		}
+		cur->uV = rstate->uV;
+		rdev->suspend_valid |= REGULATOR_CACHE_VOLTAGE;
 	}
 
-	if (rdev->desc->ops->set_suspend_mode && rstate->mode > 0) {
+	if (rdev->desc->ops->set_suspend_mode && rstate->mode > 0 &&
+	    (!(rdev->suspend_valid & REGULATOR_CACHE_MODE) ||
+	     cur->mode != rstate->mode)) {
+		rdev->suspend_valid &= ~REGULATOR_CACHE_MODE;
 		ret = rdev->desc->ops->set_suspend_mode(rdev, rstate->mode);
 		if (ret < 0) {
 			printk(KERN_ERR "%s: failed to set mode\n", __func__);
 			return ret;
 		}
+		cur->mode = rstate->mode;
+		rdev->suspend_valid |= REGULATOR_CACHE_MODE;
 	}
 	return ret;
 }
@@ -698,12 +1910,19 @@ static int set_machine_constraints(struct regulator_dev *rdev,
 		name = "regulator";
 
 	rdev->constraints = constraints;
+	rdev->off_delay_ms = constraints->off_delay_ms;
+
+	ret = regulator_init_voltages(rdev);
+	if (ret < 0) {
+		rdev->constraints = NULL;
+		goto out;
+	}
 
 	/* do we need to apply the constraint voltage */
 	if (rdev->constraints->apply_uV &&
 		rdev->constraints->min_uV == rdev->constraints->max_uV &&
-		ops->set_voltage) {
-		ret = ops->set_voltage(rdev,
+		rdev_can_set_voltage(rdev)) {
+		ret = _regulator_do_set_voltage(rdev,
 			rdev->constraints->min_uV, rdev->constraints->max_uV);
 			if (ret < 0) {
 				printk(KERN_ERR "%s: failed to apply %duV constraint to %s\n",
@@ -741,10 +1960,16 @@ static int set_machine_constraints(struct regulator_dev *rdev,
 			rdev->constraints = NULL;
 			goto out;
 		}
+		rdev_cache_store(rdev, REGULATOR_CACHE_STATUS, 1);
 	}
 
 	print_constraints(rdev);
 out:
+	if (ret < 0) {
+		kfree(rdev->voltages);
+		rdev->voltages = NULL;
+		rdev->n_voltages = 0;
+	}
 	return ret;
 }
 
@@ -760,17 +1985,31 @@ out:
 static int set_supply(struct regulator_dev *rdev,
 	struct regulator_dev *supply_rdev)
 {
+	struct regulator_dev **supplies;
 	int err;
 
+	/* resolve the whole chain up to the root now, our supply's own
+	 * chain already being complete */
+	supplies = kmalloc((supply_rdev->depth + 1) * sizeof(*supplies),
+			   GFP_KERNEL);
+	if (supplies == NULL)
+		return -ENOMEM;
+	supplies[0] = supply_rdev;
+	memcpy(&supplies[1], supply_rdev->supplies,
+	       supply_rdev->depth * sizeof(*supplies));
+
 	err = sysfs_create_link(&rdev->dev.kobj, &supply_rdev->dev.kobj,
 				"supply");
 	if (err) {
 		printk(KERN_ERR
 		       "%s: could not add device link %s err %d\n",
 		       __func__, supply_rdev->dev.kobj.name, err);
-		       goto out;
+		kfree(supplies);
+		goto out;
 	}
 	rdev->supply = supply_rdev;
+	rdev->supplies = supplies;
+	rdev->depth = supply_rdev->depth + 1;
 	list_add(&rdev->slist, &supply_rdev->supply_list);
 out:
 	return err;
@@ -803,23 +2042,31 @@ static int set_consumer_device_supply(struct regulator_dev *rdev,
 	node->dev = consumer_dev;
 	node->supply = supply;
 
-	list_add(&node->list, &regulator_map_list);
+	down_write(&regulator_map_sem);
+	hlist_add_head(&node->hlist,
+		       regulator_map_bucket(consumer_dev, supply));
+	up_write(&regulator_map_sem);
 	return 0;
 }
 
-static void unset_consumer_device_supply(struct regulator_dev *rdev,
-	struct device *consumer_dev)
+/* remove all supply mappings to rdev */
+static void unset_regulator_supplies(struct regulator_dev *rdev)
 {
-	struct regulator_map *node, *n;
+	struct regulator_map *node;
+	struct hlist_node *pos, *n;
+	int i;
 
-	list_for_each_entry_safe(node, n, &regulator_map_list, list) {
-		if (rdev == node->regulator &&
-			consumer_dev == node->dev) {
-			list_del(&node->list);
-			kfree(node);
-			return;
+	down_write(&regulator_map_sem);
+	for (i = 0; i < REGULATOR_MAP_HASH_SIZE; i++) {
+		hlist_for_each_entry_safe(node, pos, n,
+					  &regulator_map_hash[i], hlist) {
+			if (rdev == node->regulator) {
+				hlist_del(&node->hlist);
+				kfree(node);
+			}
 		}
 	}
+	up_write(&regulator_map_sem);
 }
 
 #define REG_STR_SIZE	32
@@ -881,20 +2128,53 @@ static struct regulator *create_regulator(struct regulator_dev *rdev,
 			device_remove_file(dev, &regulator->dev_attr);
 			goto link_name_err;
 		}
+
+		regulator_init_debugfs(regulator);
+	}
+	mutex_unlock(&rdev->mutex);
+	return regulator;
+link_name_err:
+	kfree(regulator->supply_name);
+attr_err:
+	device_remove_file(regulator->dev, &regulator->dev_attr);
+attr_name_err:
+	kfree(regulator->dev_attr.attr.name);
+overflow_err:
+	list_del(&regulator->list);
+	kfree(regulator);
+	mutex_unlock(&rdev->mutex);
+	return NULL;
+}
+
+/* regulator_map_sem held by caller */
+static struct regulator *_regulator_get(struct device *dev, const char *id)
+{
+	struct regulator_dev *rdev;
+	struct regulator *regulator;
+
+	if (id == NULL) {
+		printk(KERN_ERR "regulator: get() with no identifier\n");
+		return ERR_PTR(-ENODEV);
+	}
+
+	rdev = regulator_map_lookup(dev, id);
+	if (rdev == NULL) {
+		printk(KERN_ERR
+		       "regulator: Unable to get requested regulator: %s\n",
+		       id);
+		return ERR_PTR(-ENODEV);
+	}
+
+	if (!try_module_get(rdev->owner))
+		return ERR_PTR(-ENODEV);
+
+	regulator = create_regulator(rdev, dev, id);
+	if (regulator == NULL) {
+		module_put(rdev->owner);
+		return ERR_PTR(-ENOMEM);
 	}
-	mutex_unlock(&rdev->mutex);
+
 	return regulator;
-link_name_err:
-	kfree(regulator->supply_name);
-attr_err:
-	device_remove_file(regulator->dev, &regulator->dev_attr);
-attr_name_err:
-	kfree(regulator->dev_attr.attr.name);
-overflow_err:
-	list_del(&regulator->list);
-	kfree(regulator);
-	mutex_unlock(&rdev->mutex);
-	return NULL;
 }
 
 /**
@@ -909,41 +2189,12 @@ overflow_err:
  */
 struct regulator *regulator_get(struct device *dev, const char *id)
 {
-	struct regulator_dev *rdev;
-	struct regulator_map *map;
-	struct regulator *regulator = ERR_PTR(-ENODEV);
-
-	if (id == NULL) {
-		printk(KERN_ERR "regulator: get() with no identifier\n");
-		return regulator;
-	}
-
-	mutex_lock(&regulator_list_mutex);
-
-	list_for_each_entry(map, &regulator_map_list, list) {
-		if (dev == map->dev &&
-		    strcmp(map->supply, id) == 0) {
-			rdev = map->regulator;
-			goto found;
-		}
-	}
-	printk(KERN_ERR "regulator: Unable to get requested regulator: %s\n",
-	       id);
-	mutex_unlock(&regulator_list_mutex);
-	return regulator;
-
-found:
-	if (!try_module_get(rdev->owner))
-		goto out;
+	struct regulator *regulator;
 
-	regulator = create_regulator(rdev, dev, id);
-	if (regulator == NULL) {
-		regulator = ERR_PTR(-ENOMEM);
-		module_put(rdev->owner);
-	}
+	down_read(&regulator_map_sem);
+	regulator = _regulator_get(dev, id);
+	up_read(&regulator_map_sem);
 
-out:
-	mutex_unlock(&regulator_list_mutex);
 	return regulator;
 }
 EXPORT_SYMBOL_GPL(regulator_get);
@@ -970,6 +2221,10 @@ void regulator_put(struct regulator *regulator)
 		regulator_disable(regulator);
 	}
 
+	mutex_lock(&regulator->rdev->mutex);
+	regulator_set_load(regulator, 0);
+	mutex_unlock(&regulator->rdev->mutex);
+
 	mutex_lock(&regulator_list_mutex);
 	rdev = regulator->rdev;
 
@@ -980,6 +2235,7 @@ void regulator_put(struct regulator *regulator)
 		device_remove_file(regulator->dev, &regulator->dev_attr);
 		kfree(regulator->dev_attr.attr.name);
 	}
+	regulator_exit_debugfs(regulator);
 	list_del(&regulator->list);
 	kfree(regulator);
 
@@ -989,47 +2245,246 @@ void regulator_put(struct regulator *regulator)
 EXPORT_SYMBOL_GPL(regulator_put);
 
 /* locks held by regulator_enable() */
-static int _regulator_enable(struct regulator_dev *rdev)
+/* Take the lock protecting the enable state of atomic regulators, which
+ * may also be changed without rdev->mutex by regulator_enable_atomic() */
+static inline void rdev_atomic_lock(struct regulator_dev *rdev,
+				    unsigned long *flags)
+{
+	if (rdev->desc->atomic)
+		spin_lock_irqsave(&rdev->atomic_lock, *flags);
+}
+
+static inline void rdev_atomic_unlock(struct regulator_dev *rdev,
+				      unsigned long flags)
+{
+	if (rdev->desc->atomic)
+		spin_unlock_irqrestore(&rdev->atomic_lock, flags);
+}
+
+/* Enable rdev itself and take a reference, returning 1 if this is the first
+ * reference.  rdev->mutex or rdev->atomic_lock held by caller */
+static int __regulator_enable(struct regulator_dev *rdev)
+{
+	ktime_t start;
+	int ret;
+
+	start = rdev_op_begin(rdev, REGULATOR_OP_ENABLE);
+	ret = rdev->desc->ops->enable(rdev);
+	rdev_op_end(rdev, REGULATOR_OP_ENABLE, start, ret);
+	if (ret < 0) {
+		printk(KERN_ERR "%s: failed to enable %s: %d\n",
+		       __func__, rdev->desc->name, ret);
+		rdev_cache_invalidate(rdev, REGULATOR_CACHE_STATUS);
+		return ret;
+	}
+	rdev_cache_store(rdev, REGULATOR_CACHE_STATUS, 1);
+
+	if (rdev->use_count++)
+		return 0;
+
+	rdev_event_log(rdev, REGULATOR_RECORD_ENABLE, 0);
+	return 1;
+}
+
+/*
+ * Supply chains.  set_supply() resolves the supplies of each regulator up
+ * to the root of its tree when it is registered, so enabling or disabling
+ * a regulator walks that chain rather than recursing through it.
+ *
+ * Lock order: the mutex of a regulator is always taken before those of its
+ * supplies, moving from the consumer towards the root.  Supplies are locked
+ * with their distance from the regulator being changed as the lockdep
+ * subclass.  The atomic API takes the atomic_lock of each regulator in the
+ * same order, and so does a sleeping walk for the supplies the atomic API
+ * can reach.  No mutex is taken while holding an atomic_lock.
+ */
+static inline int rdev_chain_subclass(int i)
+{
+	return min(i + 1, REGULATOR_LOCK_SUBCLASS_MAX);
+}
+
+static void rdev_chain_lock(struct regulator_dev *rdev, int i, int atomic)
 {
-	int ret = -EINVAL;
+	if (atomic)
+		spin_lock_nested(&rdev->atomic_lock, rdev_chain_subclass(i));
+	else
+		mutex_lock_nested(&rdev->mutex, rdev_chain_subclass(i));
+}
+
+static void rdev_chain_unlock(struct regulator_dev *rdev, int atomic)
+{
+	if (atomic)
+		spin_unlock(&rdev->atomic_lock);
+	else
+		mutex_unlock(&rdev->mutex);
+}
+
+/* Enable rdev itself and take a reference, leaving the supplies alone.
+ * Returns 1 if this is the first reference, which needs one on the supply.
+ * In atomic mode this busy waits for the output, otherwise the time taken
+ * by our supplies to settle is passed in *delay_us and it is increased by
+ * our own enable time, to be waited for once the locks are dropped.
+ * rdev->mutex held by caller, or rdev->atomic_lock in atomic mode */
+static int rdev_enable_self(struct regulator_dev *rdev, int atomic,
+			    int *delay_us)
+{
+	unsigned long flags;
+	int ret;
 
 	if (!rdev->constraints) {
 		printk(KERN_ERR "%s: %s has no constraints\n",
 		       __func__, rdev->desc->name);
-		return ret;
+		return -EINVAL;
 	}
 
-	/* do we need to enable the supply regulator first */
-	if (rdev->supply) {
-		ret = _regulator_enable(rdev->supply);
-		if (ret < 0) {
-			printk(KERN_ERR "%s: failed to enable %s: %d\n",
-			       __func__, rdev->desc->name, ret);
-			return ret;
-		}
+	/* still on from a deferred disable, just take it back along with
+	 * the supply reference it held */
+	if (rdev->disable_pending) {
+		cancel_delayed_work(&rdev->disable_work);
+		rdev->disable_pending = 0;
+		rdev->disables_avoided++;
+		rdev->use_count++;
+		return 0;
 	}
 
+	if (!rdev->desc->ops->enable)
+		return -EINVAL;
+
 	/* check voltage and requested load before enabling */
-	if (rdev->desc->ops->enable) {
+	if (!atomic &&
+	    (rdev->constraints->valid_ops_mask & REGULATOR_CHANGE_DRMS))
+		drms_uA_update(rdev);
+
+	if (!atomic)
+		rdev_atomic_lock(rdev, &flags);
+	ret = __regulator_enable(rdev);
+	if (!atomic)
+		rdev_atomic_unlock(rdev, flags);
+	if (ret <= 0)
+		return ret;
 
-		if (rdev->constraints &&
-			(rdev->constraints->valid_ops_mask &
-			REGULATOR_CHANGE_DRMS))
-			drms_uA_update(rdev);
+	ret = _regulator_enable_time(rdev);
+	if (atomic) {
+		/* don't return until the output is usable */
+		if (ret > 0)
+			udelay(ret);
+	} else {
+		if (ret > 0)
+			*delay_us += ret;
+		rdev_settle_after(rdev, *delay_us);
+	}
 
-		ret = rdev->desc->ops->enable(rdev);
-		if (ret < 0) {
-			printk(KERN_ERR "%s: failed to enable %s: %d\n",
-			       __func__, rdev->desc->name, ret);
-			return ret;
-		}
-		rdev->use_count++;
-		return ret;
+	return 1;
+}
+
+static void rdev_put_supplies(struct regulator_dev *rdev, int from,
+			      int atomic);
+
+/* Index of the first supply of rdev from which the rest of the chain is
+ * atomic, or rdev->depth if the root isn't.  Those supplies may also be
+ * changed by the atomic API, so even a sleeping walk has to use their
+ * atomic_lock for their state to hold still. */
+static int rdev_atomic_split(struct regulator_dev *rdev, int atomic)
+{
+	int i;
+
+	if (atomic)
+		return 0;
+
+	for (i = rdev->depth; i > 0; i--)
+		if (!rdev->supplies[i - 1]->desc->atomic)
+			break;
+
+	return i;
+}
+
+/* Take the supply reference for the first reference on rdev.  The supplies
+ * which are off are locked walking up the chain until one which is on is
+ * found, then each is enabled and unlocked walking back down.  Only that
+ * part of the chain which has to change is held, and each supply stays
+ * locked from the check of its state until the reference is taken.
+ *
+ * In a sleeping walk the atomic part of the chain is handled as in the
+ * atomic API, with interrupts off from the first atomic_lock taken until
+ * the last is dropped. */
+static int rdev_get_supplies(struct regulator_dev *rdev, int atomic,
+			     int *delay_us)
+{
+	struct regulator_dev *supply;
+	unsigned long flags = 0;
+	int i, top, split, ret = 0;
+
+	split = rdev_atomic_split(rdev, atomic);
+
+	for (top = 0; top < rdev->depth; top++) {
+		supply = rdev->supplies[top];
+		if (!atomic && top == split)
+			local_irq_save(flags);
+		rdev_chain_lock(supply, top, top >= split);
+		if (supply->use_count || supply->disable_pending)
+			break;
+	}
+	if (top == rdev->depth)
+		top--;
+
+	for (i = top; i >= 0; i--) {
+		supply = rdev->supplies[i];
+		ret = rdev_enable_self(supply, i >= split, delay_us);
+		rdev_chain_unlock(supply, i >= split);
+		if (!atomic && i == split)
+			local_irq_restore(flags);
+		if (ret < 0)
+			break;
+	}
+	if (ret >= 0)
+		return 0;
+
+	printk(KERN_ERR "%s: failed to enable supply %s of %s: %d\n",
+	       __func__, supply->desc->name, rdev->desc->name, ret);
+
+	/* give back what we took above the failure, if anything: when the
+	 * first supply we tried failed we hold no reference at all */
+	if (i < top)
+		rdev_put_supplies(rdev, i + 1, atomic);
+	while (--i >= 0) {
+		rdev_chain_unlock(rdev->supplies[i], i >= split);
+		if (!atomic && i == split)
+			local_irq_restore(flags);
 	}
 
 	return ret;
 }
 
+/* rdev->mutex held by caller, or rdev->atomic_lock in atomic mode.  See
+ * rdev_settle_after() for waiting for the output in the sleeping case. */
+static int rdev_enable(struct regulator_dev *rdev, int atomic)
+{
+	int get_supplies, ret, delay = 0;
+
+	/* the first reference on a regulator holds one on its supply */
+	get_supplies = rdev->depth && !rdev->use_count &&
+		!rdev->disable_pending;
+	if (get_supplies) {
+		ret = rdev_get_supplies(rdev, atomic, &delay);
+		if (ret < 0)
+			return ret;
+	}
+
+	ret = rdev_enable_self(rdev, atomic, &delay);
+
+	/* an atomic regulator may have been enabled from the other API
+	 * since we looked, in which case it already has its supply */
+	if (get_supplies && ret <= 0)
+		rdev_put_supplies(rdev, 0, atomic);
+
+	return ret < 0 ? ret : 0;
+}
+
+static int _regulator_enable(struct regulator_dev *rdev)
+{
+	return rdev_enable(rdev, 0);
+}
+
 /**
  * regulator_enable - enable regulator output
  * @regulator: regulator source
@@ -1039,10 +2494,13 @@ static int _regulator_enable(struct regulator_dev *rdev)
  * hardwired in the regulator.
  * NOTE: calls to regulator_enable() must be balanced with calls to
  * regulator_disable().
+ * NOTE: this does not return until the output has settled, see
+ * regulator_enable_async() for a non blocking version.
  */
 int regulator_enable(struct regulator *regulator)
 {
-	int ret;
+	ktime_t start = ktime_get();
+	int ret, delay;
 
 	if (regulator->enabled) {
 		printk(KERN_CRIT "Regulator %s already enabled\n",
@@ -1052,50 +2510,187 @@ int regulator_enable(struct regulator *regulator)
 	}
 
 	mutex_lock(&regulator->rdev->mutex);
+	regulator_energy_update(regulator->rdev);
 	regulator->enabled = 1;
-	ret = _regulator_enable(regulator->rdev);
-	if (ret != 0)
+
+	/* our voltage request may not have been applied while disabled */
+	ret = 0;
+	if (regulator->max_uV)
+		ret = regulator_update_voltage(regulator->rdev, regulator);
+	if (ret >= 0) {
+		rdev_settle_after(regulator->rdev, ret);
+		ret = _regulator_enable(regulator->rdev);
+	}
+	if (ret != 0) {
 		regulator->enabled = 0;
+
+		/* put back the voltage the other consumers had */
+		if (regulator->max_uV)
+			rdev_settle_after(regulator->rdev,
+				regulator_update_voltage(regulator->rdev,
+							 NULL));
+	}
+	delay = rdev_settle_remaining(regulator->rdev);
 	mutex_unlock(&regulator->rdev->mutex);
+
+	regulator_settle(delay);
+
+	regulator_op_account(regulator, REGULATOR_OP_ENABLE, start, ret);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_enable);
 
 /* locks held by regulator_disable() */
-static int _regulator_disable(struct regulator_dev *rdev)
+/* Turn the output off.  rdev->mutex or rdev->atomic_lock held by caller */
+static int _regulator_do_disable(struct regulator_dev *rdev)
 {
-	int ret = 0;
+	ktime_t start;
+	int ret;
+
+	if (!rdev->desc->ops->disable)
+		return 0;
+
+	start = rdev_op_begin(rdev, REGULATOR_OP_DISABLE);
+	ret = rdev->desc->ops->disable(rdev);
+	rdev_op_end(rdev, REGULATOR_OP_DISABLE, start, ret);
+	if (ret < 0) {
+		printk(KERN_ERR "%s: failed to disable %s\n",
+		       __func__, rdev->desc->name);
+		rdev_cache_invalidate(rdev, REGULATOR_CACHE_STATUS);
+		return ret;
+	}
+	rdev_cache_store(rdev, REGULATOR_CACHE_STATUS, 0);
+	rdev_event_log(rdev, REGULATOR_RECORD_DISABLE, 0);
+
+	return 0;
+}
+
+/* Drop a reference to rdev itself, returning 1 if it was the last one and
+ * the supply reference should be dropped too.  rdev->mutex or
+ * rdev->atomic_lock held by caller */
+static int __regulator_disable(struct regulator_dev *rdev)
+{
+	int ret;
 
 	/* are we the last user and permitted to disable ? */
 	if (rdev->use_count == 1 && !rdev->constraints->always_on) {
 
 		/* we are last user */
-		if (rdev->desc->ops->disable) {
-			ret = rdev->desc->ops->disable(rdev);
-			if (ret < 0) {
-				printk(KERN_ERR "%s: failed to disable %s\n",
-				       __func__, rdev->desc->name);
-				return ret;
-			}
-		}
-
-		/* decrease our supplies ref count and disable if required */
-		if (rdev->supply)
-			_regulator_disable(rdev->supply);
+		ret = _regulator_do_disable(rdev);
+		if (ret < 0)
+			return ret;
 
 		rdev->use_count = 0;
-	} else if (rdev->use_count > 1) {
+		return 1;
+	} else if (rdev->use_count > 1)
+		rdev->use_count--;
 
-		if (rdev->constraints &&
-			(rdev->constraints->valid_ops_mask &
-			REGULATOR_CHANGE_DRMS))
-			drms_uA_update(rdev);
+	return 0;
+}
 
-		rdev->use_count--;
+/* Drop a reference to rdev itself, leaving the supplies alone.  Returns 1
+ * if that turned it off and the supply reference should be dropped too.
+ * rdev->mutex held by caller, or rdev->atomic_lock in atomic mode */
+static int rdev_disable_self(struct regulator_dev *rdev, int atomic)
+{
+	unsigned long flags;
+	int ret;
+
+	if (atomic)
+		return __regulator_disable(rdev);
+
+	if (rdev->use_count > 1 && rdev->constraints &&
+	    (rdev->constraints->valid_ops_mask & REGULATOR_CHANGE_DRMS))
+		drms_uA_update(rdev);
+
+	/* last user of a regulator with an off delay, leave the output on
+	 * for a while in case it is wanted again */
+	if (rdev->use_count == 1 && rdev->off_delay_ms &&
+	    !rdev->constraints->always_on && !rdev->desc->atomic &&
+	    rdev->desc->ops->disable) {
+		rdev->use_count = 0;
+		rdev->disable_pending = 1;
+		rdev->disables_deferred++;
+		queue_delayed_work(regulator_wq, &rdev->disable_work,
+				   msecs_to_jiffies(rdev->off_delay_ms));
+		return 0;
 	}
+
+	rdev_atomic_lock(rdev, &flags);
+	ret = __regulator_disable(rdev);
+	rdev_atomic_unlock(rdev, flags);
+
 	return ret;
 }
 
+/* Drop the supply reference held by rdev on supplies[from], carrying on up
+ * the chain while supplies turn off.  Each supply is locked on its own; if
+ * one we turned off is enabled again before we move on it takes its own
+ * reference on the next supply, so ours can still be dropped. */
+static void rdev_put_supplies(struct regulator_dev *rdev, int from,
+			      int atomic)
+{
+	struct regulator_dev *supply;
+	unsigned long flags = 0;
+	int i, split, ret;
+
+	split = rdev_atomic_split(rdev, atomic);
+
+	for (i = from; i < rdev->depth; i++) {
+		supply = rdev->supplies[i];
+		if (!atomic && i >= split)
+			local_irq_save(flags);
+		rdev_chain_lock(supply, i, i >= split);
+		ret = rdev_disable_self(supply, i >= split);
+		rdev_chain_unlock(supply, i >= split);
+		if (!atomic && i >= split)
+			local_irq_restore(flags);
+		if (ret <= 0)
+			break;
+	}
+}
+
+/* Complete a deferred disable, unless the regulator was enabled again */
+static void regulator_disable_work(struct work_struct *work)
+{
+	struct regulator_dev *rdev =
+		container_of(work, struct regulator_dev, disable_work.work);
+
+	mutex_lock(&rdev->mutex);
+	if (!rdev->disable_pending)
+		goto out;
+
+	/* on failure leave it pending, the next enable will pick it up */
+	if (_regulator_do_disable(rdev) < 0)
+		goto out;
+
+	rdev->disable_pending = 0;
+	rdev_put_supplies(rdev, 0, 0);
+out:
+	mutex_unlock(&rdev->mutex);
+}
+
+/* rdev->mutex held by caller, or rdev->atomic_lock in atomic mode */
+static int rdev_disable(struct regulator_dev *rdev, int atomic)
+{
+	int ret;
+
+	ret = rdev_disable_self(rdev, atomic);
+	if (ret < 0)
+		return ret;
+
+	/* decrease our supplies ref count and disable if required */
+	if (ret)
+		rdev_put_supplies(rdev, 0, atomic);
+
+	return 0;
+}
+
+static int _regulator_disable(struct regulator_dev *rdev)
+{
+	return rdev_disable(rdev, 0);
+}
+
 /**
  * regulator_disable - disable regulator output
  * @regulator: regulator source
@@ -1108,7 +2703,8 @@ static int _regulator_disable(struct regulator_dev *rdev)
  */
 int regulator_disable(struct regulator *regulator)
 {
-	int ret;
+	ktime_t start = ktime_get();
+	int ret, delay;
 
 	if (!regulator->enabled) {
 		printk(KERN_ERR "%s: not in use by this consumer\n",
@@ -1117,92 +2713,265 @@ int regulator_disable(struct regulator *regulator)
 	}
 
 	mutex_lock(&regulator->rdev->mutex);
+	regulator_energy_update(regulator->rdev);
 	regulator->enabled = 0;
-	regulator->uA_load = 0;
+	regulator_set_load(regulator, 0);
 	ret = _regulator_disable(regulator->rdev);
+
+	/* the remaining consumers may be happy with a lower voltage */
+	if (regulator->max_uV)
+		rdev_settle_after(regulator->rdev,
+			regulator_update_voltage(regulator->rdev, NULL));
+	delay = rdev_settle_remaining(regulator->rdev);
+
 	mutex_unlock(&regulator->rdev->mutex);
+
+	regulator_settle(delay);
+
+	regulator_op_account(regulator, REGULATOR_OP_DISABLE, start, ret);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_disable);
 
-/* locks held by regulator_force_disable() */
+/* locks held by regulator_force_disable().  Returns 1 if the output was
+ * forced off, in which case the caller notifies the consumers once it has
+ * dropped rdev->mutex. */
 static int _regulator_force_disable(struct regulator_dev *rdev)
 {
-	int ret = 0;
+	unsigned long flags;
+	ktime_t start;
+	int held, ret = 0;
+
+	/* a deferred disable would only drop our supply again */
+	held = rdev->use_count || rdev->disable_pending;
+	if (rdev->disable_pending) {
+		cancel_delayed_work(&rdev->disable_work);
+		rdev->disable_pending = 0;
+	}
 
 	/* force disable */
 	if (rdev->desc->ops->disable) {
 		/* ah well, who wants to live forever... */
+		rdev_atomic_lock(rdev, &flags);
+		start = rdev_op_begin(rdev, REGULATOR_OP_DISABLE);
 		ret = rdev->desc->ops->disable(rdev);
+		rdev_op_end(rdev, REGULATOR_OP_DISABLE, start, ret);
 		if (ret < 0) {
+			rdev_atomic_unlock(rdev, flags);
 			printk(KERN_ERR "%s: failed to force disable %s\n",
 			       __func__, rdev->desc->name);
+			rdev_cache_invalidate(rdev, REGULATOR_CACHE_STATUS);
 			return ret;
 		}
-		/* notify other consumers that power has been forced off */
-		_notifier_call_chain(rdev, REGULATOR_EVENT_FORCE_DISABLE,
-			NULL);
+		rdev_cache_store(rdev, REGULATOR_CACHE_STATUS, 0);
+		rdev_atomic_unlock(rdev, flags);
+		rdev_event_log(rdev, REGULATOR_RECORD_DISABLE, 0);
+		ret = 1;
+	}
+
+	/* decrease our supplies ref count and disable if required */
+	if (held)
+		rdev_put_supplies(rdev, 0, 0);
+
+	rdev->use_count = 0;
+	return ret;
+}
+
+/**
+ * regulator_force_disable - force disable regulator output
+ * @regulator: regulator source
+ *
+ * Forcibly disable the regulator output voltage or current.
+ * NOTE: this *will* disable the regulator output even if other consumer
+ * devices have it enabled. This should be used for situations when device
+ * damage will likely occur if the regulator is not disabled (e.g. over temp).
+ */
+int regulator_force_disable(struct regulator *regulator)
+{
+	int ret;
+
+	mutex_lock(&regulator->rdev->mutex);
+	regulator_energy_update(regulator->rdev);
+	regulator->enabled = 0;
+	regulator_set_load(regulator, 0);
+	ret = _regulator_force_disable(regulator->rdev);
+	mutex_unlock(&regulator->rdev->mutex);
+
+	/* notify other consumers that power has been forced off */
+	if (ret > 0) {
+		_notifier_call_chain(regulator->rdev,
+				     REGULATOR_EVENT_FORCE_DISABLE, NULL);
+		ret = 0;
+	}
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(regulator_force_disable);
+
+/* rdev->mutex held by caller */
+static int _regulator_is_enabled(struct regulator_dev *rdev)
+{
+	unsigned int gen = rdev->cache_gen;
+	int ret;
+
+	if (rdev_cache_read(rdev, REGULATOR_CACHE_STATUS, &ret))
+		return ret;
+
+	/* sanity check */
+	if (!rdev->desc->ops->is_enabled)
+		return -EINVAL;
+
+	ret = rdev->desc->ops->is_enabled(rdev);
+	if (ret >= 0)
+		rdev_cache_fill(rdev, REGULATOR_CACHE_STATUS, ret, gen);
+	return ret;
+}
+
+/**
+ * regulator_is_enabled - is the regulator output enabled
+ * @regulator: regulator source
+ *
+ * Returns zero for disabled otherwise return number of enable requests.
+ */
+int regulator_is_enabled(struct regulator *regulator)
+{
+	return rdev_read_state(regulator->rdev, REGULATOR_CACHE_STATUS,
+			       _regulator_is_enabled);
+}
+EXPORT_SYMBOL_GPL(regulator_is_enabled);
+
+/* The atomic API may only be used if rdev and all its supplies were
+ * registered as never sleeping */
+static int regulator_check_atomic(struct regulator_dev *rdev)
+{
+	struct regulator_dev *r;
+	int i;
+
+	for (i = -1; i < rdev->depth; i++) {
+		r = i < 0 ? rdev : rdev->supplies[i];
+		if (!r->desc->atomic) {
+			printk(KERN_ERR "%s: %s may sleep, "
+			       "atomic access not supported\n",
+			       __func__, r->desc->name);
+			return -EPERM;
+		}
 	}
 
-	/* decrease our supplies ref count and disable if required */
-	if (rdev->supply)
-		_regulator_disable(rdev->supply);
+	return 0;
+}
+
+/* regulator->enabled of consumers using the atomic API is protected by
+ * rdev->atomic_lock rather than rdev->mutex */
+static int rdev_enable_atomic(struct regulator *regulator)
+{
+	struct regulator_dev *rdev = regulator->rdev;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&rdev->atomic_lock, flags);
+	ret = rdev_enable(rdev, 1);
+	if (ret == 0)
+		regulator->enabled = 1;
+	spin_unlock_irqrestore(&rdev->atomic_lock, flags);
 
-	rdev->use_count = 0;
 	return ret;
 }
 
+static void rdev_disable_atomic(struct regulator *regulator)
+{
+	struct regulator_dev *rdev = regulator->rdev;
+	unsigned long flags;
+
+	spin_lock_irqsave(&rdev->atomic_lock, flags);
+	regulator->enabled = 0;
+	rdev_disable(rdev, 1);
+	spin_unlock_irqrestore(&rdev->atomic_lock, flags);
+}
+
 /**
- * regulator_force_disable - force disable regulator output
+ * regulator_enable_atomic - enable regulator output from atomic context
  * @regulator: regulator source
  *
- * Forcibly disable the regulator output voltage or current.
- * NOTE: this *will* disable the regulator output even if other consumer
- * devices have it enabled. This should be used for situations when device
- * damage will likely occur if the regulator is not disabled (e.g. over temp).
+ * Like regulator_enable() but never sleeps, so may be called with
+ * interrupts disabled or spinlocks held.  Only regulators registered as
+ * atomic, with atomic supplies, support this and the consumer voltage and
+ * load requests are not applied.  Returns -EPERM for any other regulator.
+ * NOTE: this busy waits for the output to settle.
+ * NOTE: a consumer must not mix these calls with regulator_enable() and
+ * regulator_disable() on the same regulator, the consumer enable state is
+ * protected by different locks in the two APIs.
  */
-int regulator_force_disable(struct regulator *regulator)
+int regulator_enable_atomic(struct regulator *regulator)
 {
 	int ret;
 
-	mutex_lock(&regulator->rdev->mutex);
-	regulator->enabled = 0;
-	regulator->uA_load = 0;
-	ret = _regulator_force_disable(regulator->rdev);
-	mutex_unlock(&regulator->rdev->mutex);
-	return ret;
+	ret = regulator_check_atomic(regulator->rdev);
+	if (ret < 0)
+		return ret;
+
+	if (regulator->enabled) {
+		printk(KERN_CRIT "Regulator %s already enabled\n",
+		       regulator->supply_name);
+		WARN_ON(regulator->enabled);
+		return 0;
+	}
+
+	return rdev_enable_atomic(regulator);
 }
-EXPORT_SYMBOL_GPL(regulator_force_disable);
+EXPORT_SYMBOL_GPL(regulator_enable_atomic);
 
-static int _regulator_is_enabled(struct regulator_dev *rdev)
+/**
+ * regulator_disable_atomic - disable regulator output from atomic context
+ * @regulator: regulator source
+ *
+ * Like regulator_disable() but never sleeps.  See regulator_enable_atomic().
+ */
+int regulator_disable_atomic(struct regulator *regulator)
 {
 	int ret;
 
-	mutex_lock(&rdev->mutex);
+	ret = regulator_check_atomic(regulator->rdev);
+	if (ret < 0)
+		return ret;
 
-	/* sanity check */
-	if (!rdev->desc->ops->is_enabled) {
-		ret = -EINVAL;
-		goto out;
+	if (!regulator->enabled) {
+		printk(KERN_ERR "%s: not in use by this consumer\n",
+			__func__);
+		return 0;
 	}
 
-	ret = rdev->desc->ops->is_enabled(rdev);
-out:
-	mutex_unlock(&rdev->mutex);
-	return ret;
+	rdev_disable_atomic(regulator);
+
+	return 0;
 }
+EXPORT_SYMBOL_GPL(regulator_disable_atomic);
 
 /**
- * regulator_is_enabled - is the regulator output enabled
+ * regulator_is_enabled_atomic - is the regulator output enabled
  * @regulator: regulator source
  *
- * Returns zero for disabled otherwise return number of enable requests.
+ * Like regulator_is_enabled() but never sleeps.  Only regulators registered
+ * as atomic support this, -EPERM is returned for any other regulator.
  */
-int regulator_is_enabled(struct regulator *regulator)
+int regulator_is_enabled_atomic(struct regulator *regulator)
 {
-	return _regulator_is_enabled(regulator->rdev);
+	struct regulator_dev *rdev = regulator->rdev;
+	unsigned long flags;
+	int ret;
+
+	if (!rdev->desc->atomic) {
+		printk(KERN_ERR "%s: %s may sleep, atomic access not supported\n",
+		       __func__, rdev->desc->name);
+		return -EPERM;
+	}
+
+	spin_lock_irqsave(&rdev->atomic_lock, flags);
+	ret = _regulator_is_enabled(rdev);
+	spin_unlock_irqrestore(&rdev->atomic_lock, flags);
+
+	return ret;
 }
-EXPORT_SYMBOL_GPL(regulator_is_enabled);
+EXPORT_SYMBOL_GPL(regulator_is_enabled_atomic);
 
 /**
  * regulator_set_voltage - set regulator output voltage
@@ -1218,19 +2987,24 @@ EXPORT_SYMBOL_GPL(regulator_is_enabled);
  * output at the new voltage when enabled.
  *
  * NOTE: If the regulator is shared between several devices then the lowest
- * request voltage that meets the system constraints will be used.
+ * voltage that meets the requests of all enabled consumers and the system
+ * constraints will be used.  The hardware is only written to when this
+ * changes.
  * NOTE: Regulator system constraints must be set for this regulator before
  * calling this function otherwise this call will fail.
+ * NOTE: if the regulator is enabled this does not return until the output
+ * has settled at the new voltage.
  */
 int regulator_set_voltage(struct regulator *regulator, int min_uV, int max_uV)
 {
 	struct regulator_dev *rdev = regulator->rdev;
-	int ret;
+	ktime_t start = ktime_get();
+	int ret, old_min_uV, old_max_uV, delay = 0;
 
 	mutex_lock(&rdev->mutex);
 
 	/* sanity check */
-	if (!rdev->desc->ops->set_voltage) {
+	if (!rdev_can_set_voltage(rdev)) {
 		ret = -EINVAL;
 		goto out;
 	}
@@ -1239,23 +3013,150 @@ int regulator_set_voltage(struct regulator *regulator, int min_uV, int max_uV)
 	ret = regulator_check_voltage(rdev, &min_uV, &max_uV);
 	if (ret < 0)
 		goto out;
+
+	old_min_uV = regulator->min_uV;
+	old_max_uV = regulator->max_uV;
 	regulator->min_uV = min_uV;
 	regulator->max_uV = max_uV;
-	ret = rdev->desc->ops->set_voltage(rdev, min_uV, max_uV);
+
+	ret = regulator_update_voltage(rdev, regulator);
+	if (ret < 0) {
+		regulator->min_uV = old_min_uV;
+		regulator->max_uV = old_max_uV;
+	} else {
+		rdev_settle_after(rdev, ret);
+		delay = rdev_settle_remaining(rdev);
+		ret = 0;
+	}
 
 out:
 	mutex_unlock(&rdev->mutex);
+
+	regulator_settle(delay);
+
+	regulator_op_account(regulator, REGULATOR_OP_SET_VOLTAGE, start, ret);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_set_voltage);
 
+static void regulator_enable_work(struct work_struct *work)
+{
+	struct regulator_async *async =
+		container_of(work, struct regulator_async, work);
+	int ret;
+
+	ret = regulator_enable(async->regulator);
+	async->complete(async->regulator, ret, async->data);
+	kfree(async);
+}
+
+static void regulator_set_voltage_work(struct work_struct *work)
+{
+	struct regulator_async *async =
+		container_of(work, struct regulator_async, work);
+	int ret;
+
+	ret = regulator_set_voltage(async->regulator, async->min_uV,
+				    async->max_uV);
+	async->complete(async->regulator, ret, async->data);
+	kfree(async);
+}
+
+static int regulator_queue_async(struct regulator *regulator,
+	int min_uV, int max_uV, work_func_t func,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data)
+{
+	struct regulator_async *async;
+
+	async = kzalloc(sizeof(*async), GFP_KERNEL);
+	if (async == NULL)
+		return -ENOMEM;
+
+	async->regulator = regulator;
+	async->min_uV = min_uV;
+	async->max_uV = max_uV;
+	async->complete = complete;
+	async->data = data;
+	INIT_WORK(&async->work, func);
+	queue_work(regulator_wq, &async->work);
+
+	return 0;
+}
+
+/**
+ * regulator_enable_async - enable regulator output without waiting
+ * @regulator: regulator source
+ * @complete: called once the output is enabled and has settled
+ * @data: passed to complete
+ *
+ * Non blocking version of regulator_enable().  The enable is done from
+ * process context and complete() is called with its result once the
+ * output is stable, allowing the consumer to get on with other work
+ * while the regulator ramps.  The consumer must not put the regulator
+ * before complete() has been called.
+ *
+ * Returns zero if the enable was queued.
+ */
+int regulator_enable_async(struct regulator *regulator,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data)
+{
+	return regulator_queue_async(regulator, 0, 0, regulator_enable_work,
+				     complete, data);
+}
+EXPORT_SYMBOL_GPL(regulator_enable_async);
+
+/**
+ * regulator_set_voltage_async - set regulator output voltage without waiting
+ * @regulator: regulator source
+ * @min_uV: Minimum required voltage in uV
+ * @max_uV: Maximum acceptable voltage in uV
+ * @complete: called once the output has settled at the new voltage
+ * @data: passed to complete
+ *
+ * Non blocking version of regulator_set_voltage(), see
+ * regulator_enable_async() for details.
+ *
+ * Returns zero if the voltage change was queued.
+ */
+int regulator_set_voltage_async(struct regulator *regulator,
+	int min_uV, int max_uV,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data)
+{
+	return regulator_queue_async(regulator, min_uV, max_uV,
+				     regulator_set_voltage_work,
+				     complete, data);
+}
+EXPORT_SYMBOL_GPL(regulator_set_voltage_async);
+
+/* rdev->mutex held by caller */
 static int _regulator_get_voltage(struct regulator_dev *rdev)
 {
+	unsigned int gen = rdev->cache_gen;
+	ktime_t start;
+	int ret;
+
+	if (rdev_cache_read(rdev, REGULATOR_CACHE_VOLTAGE, &ret))
+		return ret;
+
 	/* sanity check */
-	if (rdev->desc->ops->get_voltage)
-		return rdev->desc->ops->get_voltage(rdev);
-	else
+	if (!rdev_can_get_voltage(rdev))
 		return -EINVAL;
+
+	start = rdev_op_begin(rdev, REGULATOR_OP_GET_VOLTAGE);
+	if (rdev->desc->ops->get_voltage) {
+		ret = rdev->desc->ops->get_voltage(rdev);
+	} else {
+		ret = rdev->desc->ops->get_voltage_sel(rdev);
+		if (ret >= 0)
+			ret = _regulator_list_voltage(rdev, ret);
+	}
+	rdev_op_end(rdev, REGULATOR_OP_GET_VOLTAGE, start, ret);
+	if (ret >= 0)
+		rdev_cache_fill(rdev, REGULATOR_CACHE_VOLTAGE, ret, gen);
+	return ret;
 }
 
 /**
@@ -1269,17 +3170,48 @@ static int _regulator_get_voltage(struct regulator_dev *rdev)
  */
 int regulator_get_voltage(struct regulator *regulator)
 {
-	int ret;
+	return rdev_read_state(regulator->rdev, REGULATOR_CACHE_VOLTAGE,
+			       _regulator_get_voltage);
+}
+EXPORT_SYMBOL_GPL(regulator_get_voltage);
 
-	mutex_lock(&regulator->rdev->mutex);
+/**
+ * regulator_count_voltages - count regulator_list_voltage() selectors
+ * @regulator: regulator source
+ *
+ * Returns the number of voltages the regulator can be set to within its
+ * constraints, or zero if they are not known.
+ */
+int regulator_count_voltages(struct regulator *regulator)
+{
+	struct regulator_dev *rdev = regulator->rdev;
 
-	ret = _regulator_get_voltage(regulator->rdev);
+	if (!rdev->voltages)
+		return 0;
 
-	mutex_unlock(&regulator->rdev->mutex);
+	return rdev->volt_hi - rdev->volt_lo + 1;
+}
+EXPORT_SYMBOL_GPL(regulator_count_voltages);
 
-	return ret;
+/**
+ * regulator_list_voltage - enumerate supported voltages
+ * @regulator: regulator source
+ * @selector: identify voltage to list
+ *
+ * Returns the voltage in uV for @selector, from zero to one less than
+ * regulator_count_voltages(), in increasing order.  Returns -EINVAL if
+ * @selector is out of range.
+ */
+int regulator_list_voltage(struct regulator *regulator, unsigned selector)
+{
+	struct regulator_dev *rdev = regulator->rdev;
+
+	if (selector >= regulator_count_voltages(regulator))
+		return -EINVAL;
+
+	return rdev->voltages[rdev->volt_lo + selector].uV;
 }
-EXPORT_SYMBOL_GPL(regulator_get_voltage);
+EXPORT_SYMBOL_GPL(regulator_list_voltage);
 
 /**
  * regulator_set_current_limit - set regulator output current limit
@@ -1317,27 +3249,29 @@ int regulator_set_current_limit(struct regulator *regulator,
 		goto out;
 
 	ret = rdev->desc->ops->set_current_limit(rdev, min_uA, max_uA);
+	rdev_cache_invalidate(rdev, REGULATOR_CACHE_CURRENT);
 out:
 	mutex_unlock(&rdev->mutex);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_set_current_limit);
 
+/* rdev->mutex held by caller */
 static int _regulator_get_current_limit(struct regulator_dev *rdev)
 {
+	unsigned int gen = rdev->cache_gen;
 	int ret;
 
-	mutex_lock(&rdev->mutex);
+	if (rdev_cache_read(rdev, REGULATOR_CACHE_CURRENT, &ret))
+		return ret;
 
 	/* sanity check */
-	if (!rdev->desc->ops->get_current_limit) {
-		ret = -EINVAL;
-		goto out;
-	}
+	if (!rdev->desc->ops->get_current_limit)
+		return -EINVAL;
 
 	ret = rdev->desc->ops->get_current_limit(rdev);
-out:
-	mutex_unlock(&rdev->mutex);
+	if (ret >= 0)
+		rdev_cache_fill(rdev, REGULATOR_CACHE_CURRENT, ret, gen);
 	return ret;
 }
 
@@ -1352,10 +3286,34 @@ out:
  */
 int regulator_get_current_limit(struct regulator *regulator)
 {
-	return _regulator_get_current_limit(regulator->rdev);
+	return rdev_read_state(regulator->rdev, REGULATOR_CACHE_CURRENT,
+			       _regulator_get_current_limit);
 }
 EXPORT_SYMBOL_GPL(regulator_get_current_limit);
 
+/* rdev->mutex held by caller */
+static int _regulator_set_mode(struct regulator_dev *rdev, unsigned int mode)
+{
+	ktime_t start;
+	int ret;
+
+	start = rdev_op_begin(rdev, REGULATOR_OP_SET_MODE);
+	ret = rdev->desc->ops->set_mode(rdev, mode);
+	rdev_op_end(rdev, REGULATOR_OP_SET_MODE, start, ret);
+	if (ret == 0) {
+		rdev_cache_store(rdev, REGULATOR_CACHE_MODE, mode);
+		rdev_event_log(rdev, REGULATOR_RECORD_MODE, mode);
+		rdev->drms_mode = mode;
+		rdev->drms_mode_time = jiffies;
+		rdev->drms_gen = rdev->cache_gen;
+	} else {
+		rdev_cache_invalidate(rdev, REGULATOR_CACHE_MODE);
+		rdev->drms_mode = 0;
+	}
+
+	return ret;
+}
+
 /**
  * regulator_set_mode - set regulator operating mode
  * @regulator: regulator source
@@ -1370,6 +3328,7 @@ EXPORT_SYMBOL_GPL(regulator_get_current_limit);
 int regulator_set_mode(struct regulator *regulator, unsigned int mode)
 {
 	struct regulator_dev *rdev = regulator->rdev;
+	ktime_t start = ktime_get();
 	int ret;
 
 	mutex_lock(&rdev->mutex);
@@ -1385,133 +3344,273 @@ int regulator_set_mode(struct regulator *regulator, unsigned int mode)
 	if (ret < 0)
 		goto out;
 
-	ret = rdev->desc->ops->set_mode(rdev, mode);
+	/* an explicit mode overrides a pending deferred DRMS update */
+	drms_cancel(rdev);
+
+	ret = _regulator_set_mode(rdev, mode);
 out:
 	mutex_unlock(&rdev->mutex);
+
+	regulator_op_account(regulator, REGULATOR_OP_SET_MODE, start, ret);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_set_mode);
 
-static unsigned int _regulator_get_mode(struct regulator_dev *rdev)
+/* rdev->mutex held by caller */
+static int _regulator_get_mode(struct regulator_dev *rdev)
 {
+	unsigned int gen = rdev->cache_gen;
 	int ret;
 
-	mutex_lock(&rdev->mutex);
+	if (rdev_cache_read(rdev, REGULATOR_CACHE_MODE, &ret))
+		return ret;
 
 	/* sanity check */
-	if (!rdev->desc->ops->get_mode) {
-		ret = -EINVAL;
-		goto out;
-	}
+	if (!rdev->desc->ops->get_mode)
+		return -EINVAL;
 
 	ret = rdev->desc->ops->get_mode(rdev);
-out:
+	if (ret > 0)
+		rdev_cache_fill(rdev, REGULATOR_CACHE_MODE, ret, gen);
+	return ret;
+}
+
+/**
+ * regulator_get_mode - get regulator operating mode
+ * @regulator: regulator source
+ *
+ * Get the current regulator operating mode.
+ */
+unsigned int regulator_get_mode(struct regulator *regulator)
+{
+	return rdev_read_state(regulator->rdev, REGULATOR_CACHE_MODE,
+			       _regulator_get_mode);
+}
+EXPORT_SYMBOL_GPL(regulator_get_mode);
+
+/**
+ * regulator_set_optimum_mode - set regulator optimum operating mode
+ * @regulator: regulator source
+ * @uA_load: load current
+ *
+ * Notifies the regulator core of a new device load. This is then used by
+ * DRMS (if enabled by constraints) to set the most efficient regulator
+ * operating mode for the new regulator loading.
+ *
+ * Consumer devices notify their supply regulator of the maximum power
+ * they will require (can be taken from device datasheet in the power
+ * consumption tables) when they change operational status and hence power
+ * state. Examples of operational state changes that can affect power
+ * consumption are :-
+ *
+ *    o Device is opened / closed.
+ *    o Device I/O is about to begin or has just finished.
+ *    o Device is idling in between work.
+ *
+ * This information is also exported via sysfs to userspace.
+ *
+ * DRMS will sum the total requested load on the regulator and change
+ * to the most efficient operating mode if platform constraints allow.
+ * Platform constraints may also ask for changes to more efficient modes
+ * to be deferred, in which case the change happens some time later if
+ * the load stays low for long enough.
+ *
+ * Returns the optimum regulator mode for the new load or error.
+ */
+int regulator_set_optimum_mode(struct regulator *regulator, int uA_load)
+{
+	struct regulator_dev *rdev = regulator->rdev;
+	ktime_t start = ktime_get();
+	int ret;
+
+	mutex_lock(&rdev->mutex);
+
+	regulator_energy_update(rdev);
+	regulator_set_load(regulator, uA_load);
+	ret = drms_uA_update(rdev);
+	if (ret < 0)
+		printk(KERN_ERR "%s: failed to set optimum mode for %s @ %d uA\n",
+		       __func__, rdev->desc->name, uA_load);
+
 	mutex_unlock(&rdev->mutex);
+
+	regulator_op_account(regulator, REGULATOR_OP_SET_OPTIMUM_MODE, start,
+			     ret);
 	return ret;
 }
+EXPORT_SYMBOL_GPL(regulator_set_optimum_mode);
+
+/* Check a regulator_apply_state() change against the constraints,
+ * clamping the voltage range to them. */
+static int regulator_check_change(struct regulator_change *change,
+				  int *min_uV, int *max_uV)
+{
+	struct regulator_dev *rdev = change->consumer->rdev;
+	int ret;
+
+	*min_uV = change->min_uV;
+	*max_uV = change->max_uV;
+
+	if (change->max_uV) {
+		if (!rdev_can_set_voltage(rdev))
+			return -EINVAL;
+		ret = regulator_check_voltage(rdev, min_uV, max_uV);
+		if (ret < 0)
+			return ret;
+	}
+
+	if (change->mode) {
+		if (!rdev->desc->ops->set_mode)
+			return -EINVAL;
+		ret = regulator_check_mode(rdev, change->mode);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* Apply the voltage and mode parts of a regulator_apply_state() change.
+ * Returns the time in us to wait for the output to settle. */
+static int regulator_apply_change(struct regulator_change *change)
+{
+	struct regulator *regulator = change->consumer;
+	struct regulator_dev *rdev = regulator->rdev;
+	int ret, delay = 0, min_uV, max_uV, old_min_uV, old_max_uV;
+
+	ret = regulator_check_change(change, &min_uV, &max_uV);
+	if (ret < 0)
+		return ret;
+
+	mutex_lock(&rdev->mutex);
+
+	if (change->max_uV) {
+		old_min_uV = regulator->min_uV;
+		old_max_uV = regulator->max_uV;
+		regulator->min_uV = min_uV;
+		regulator->max_uV = max_uV;
+
+		delay = regulator_update_voltage(rdev, regulator);
+		if (delay < 0) {
+			regulator->min_uV = old_min_uV;
+			regulator->max_uV = old_max_uV;
+			ret = delay;
+			goto out;
+		}
+		rdev_settle_after(rdev, delay);
+	}
 
-/**
- * regulator_get_mode - get regulator operating mode
- * @regulator: regulator source
- *
- * Get the current regulator operating mode.
- */
-unsigned int regulator_get_mode(struct regulator *regulator)
-{
-	return _regulator_get_mode(regulator->rdev);
+	if (change->mode)
+		ret = _regulator_set_mode(rdev, change->mode);
+out:
+	mutex_unlock(&rdev->mutex);
+	if (ret < 0)
+		return ret;
+	return delay;
 }
-EXPORT_SYMBOL_GPL(regulator_get_mode);
 
 /**
- * regulator_set_optimum_mode - set regulator optimum operating mode
- * @regulator: regulator source
- * @uA_load: load current
+ * regulator_apply_state - apply changes to several regulators together
+ * @num_changes: Number of changes
+ * @changes: Array of changes to apply
  *
- * Notifies the regulator core of a new device load. This is then used by
- * DRMS (if enabled by constraints) to set the most efficient regulator
- * operating mode for the new regulator loading.
- *
- * Consumer devices notify their supply regulator of the maximum power
- * they will require (can be taken from device datasheet in the power
- * consumption tables) when they change operational status and hence power
- * state. Examples of operational state changes that can affect power
- * consumption are :-
- *
- *    o Device is opened / closed.
- *    o Device I/O is about to begin or has just finished.
- *    o Device is idling in between work.
+ * Apply a set of voltage, operating mode and enable changes as a single
+ * operation, e.g. for a DVFS step.  Everything is checked against the
+ * constraints before the hardware is touched.  The voltage and mode changes
+ * are then made with the register writes batched if the regulator driver
+ * supports it, so changes to regulators on the same PMIC as the first
+ * regulator that does can go out in a single bus transfer.  The core then
+ * waits once for all outputs to settle and finally enables or disables the
+ * consumers requested, in order.  Consumers already in the requested state
+ * are left alone.
  *
- * This information is also exported via sysfs to userspace.
+ * Only the PMIC of the first batch capable regulator is batched; changes to
+ * regulators on other PMICs are written one at a time.  Nothing is rolled
+ * back on failure: voltage and mode changes already made, and consumers
+ * already enabled or disabled, stay as they are and the caller has to
+ * restore the state it needs.
  *
- * DRMS will sum the total requested load on the regulator and change
- * to the most efficient operating mode if platform constraints allow.
+ * This must not be called with any regulator locks held.
  *
- * Returns the new regulator mode or error.
+ * Returns zero on success or the first error encountered.
  */
-int regulator_set_optimum_mode(struct regulator *regulator, int uA_load)
+int regulator_apply_state(int num_changes, struct regulator_change *changes)
 {
-	struct regulator_dev *rdev = regulator->rdev;
-	struct regulator *consumer;
-	int ret, output_uV, input_uV, total_uA_load = 0;
-	unsigned int mode;
+	struct regulator_dev *rdev, *batch = NULL;
+	struct regulator *regulator;
+	int i, ret, err, delay = 0, min_uV, max_uV;
 
-	mutex_lock(&rdev->mutex);
+	for (i = 0; i < num_changes; i++) {
+		ret = regulator_check_change(&changes[i], &min_uV, &max_uV);
+		if (ret < 0) {
+			printk(KERN_ERR "%s: invalid change for %s: %d\n",
+			       __func__, changes[i].consumer->supply_name, ret);
+			return ret;
+		}
+	}
 
-	regulator->uA_load = uA_load;
-	ret = regulator_check_drms(rdev);
-	if (ret < 0)
-		goto out;
-	ret = -EINVAL;
+	/* the batch covers the whole PMIC so one is enough */
+	for (i = 0; i < num_changes; i++) {
+		rdev = changes[i].consumer->rdev;
+		if (rdev->desc->ops->batch_begin &&
+		    rdev->desc->ops->batch_commit &&
+		    (changes[i].max_uV || changes[i].mode)) {
+			batch = rdev;
+			break;
+		}
+	}
+	if (batch) {
+		ret = batch->desc->ops->batch_begin(batch);
+		if (ret < 0) {
+			printk(KERN_ERR "%s: failed to batch %s: %d\n",
+			       __func__, batch->desc->name, ret);
+			batch = NULL;
+		}
+	}
 
-	/* sanity check */
-	if (!rdev->desc->ops->get_optimum_mode)
-		goto out;
+	ret = 0;
+	for (i = 0; i < num_changes; i++) {
+		if (!changes[i].max_uV && !changes[i].mode)
+			continue;
 
-	/* get output voltage */
-	output_uV = rdev->desc->ops->get_voltage(rdev);
-	if (output_uV <= 0) {
-		printk(KERN_ERR "%s: invalid output voltage found for %s\n",
-			__func__, rdev->desc->name);
-		goto out;
+		err = regulator_apply_change(&changes[i]);
+		if (err < 0) {
+			printk(KERN_ERR "%s: failed to change %s: %d\n",
+			       __func__, changes[i].consumer->supply_name, err);
+			ret = err;
+			break;
+		}
+		delay = max(delay, err);
 	}
 
-	/* get input voltage */
-	if (rdev->supply && rdev->supply->desc->ops->get_voltage)
-		input_uV = rdev->supply->desc->ops->get_voltage(rdev->supply);
-	else
-		input_uV = rdev->constraints->input_uV;
-	if (input_uV <= 0) {
-		printk(KERN_ERR "%s: invalid input voltage found for %s\n",
-			__func__, rdev->desc->name);
-		goto out;
+	if (batch) {
+		err = batch->desc->ops->batch_commit(batch);
+		if (err < 0) {
+			printk(KERN_ERR "%s: failed to commit %s: %d\n",
+			       __func__, batch->desc->name, err);
+			if (ret == 0)
+				ret = err;
+		}
 	}
+	if (ret < 0)
+		return ret;
 
-	/* calc total requested load for this regulator */
-	list_for_each_entry(consumer, &rdev->consumer_list, list)
-	    total_uA_load += consumer->uA_load;
+	regulator_settle(delay);
 
-	mode = rdev->desc->ops->get_optimum_mode(rdev,
-						 input_uV, output_uV,
-						 total_uA_load);
-	if (ret <= 0) {
-		printk(KERN_ERR "%s: failed to get optimum mode for %s @"
-			" %d uA %d -> %d uV\n", __func__, rdev->desc->name,
-			total_uA_load, input_uV, output_uV);
-		goto out;
-	}
+	for (i = 0; i < num_changes; i++) {
+		regulator = changes[i].consumer;
 
-	ret = rdev->desc->ops->set_mode(rdev, mode);
-	if (ret <= 0) {
-		printk(KERN_ERR "%s: failed to set optimum mode %x for %s\n",
-			__func__, mode, rdev->desc->name);
-		goto out;
+		if (changes[i].enable > 0 && !regulator->enabled)
+			ret = regulator_enable(regulator);
+		else if (changes[i].enable < 0 && regulator->enabled)
+			ret = regulator_disable(regulator);
+		if (ret < 0)
+			return ret;
 	}
-	ret = mode;
-out:
-	mutex_unlock(&rdev->mutex);
-	return ret;
+
+	return 0;
 }
-EXPORT_SYMBOL_GPL(regulator_set_optimum_mode);
+EXPORT_SYMBOL_GPL(regulator_apply_state);
 
 /**
  * regulator_register_notifier - register regulator event notifier
@@ -1543,20 +3642,51 @@ int regulator_unregister_notifier(struct regulator *regulator,
 }
 EXPORT_SYMBOL_GPL(regulator_unregister_notifier);
 
-/* notify regulator consumers and downstream regulator consumers */
+/* notify the consumers of one regulator */
+static void rdev_notify(struct regulator_dev *rdev, unsigned long event)
+{
+	unsigned long flags;
+
+	/* events mean the hardware may have changed state behind our back
+	 * so drop anything we have cached */
+	write_seqlock_irqsave(&rdev->cache_lock, flags);
+	rdev->cache_valid = 0;
+	rdev->cache_gen++;
+	write_sequnlock_irqrestore(&rdev->cache_lock, flags);
+	blocking_notifier_call_chain(&rdev->notifier, event, NULL);
+}
+
+/* notify regulator consumers and downstream regulator consumers.  The tree
+ * below rdev is walked depth first without recursion and without taking any
+ * regulator locks, so a notifier in one subtree never waits behind a
+ * regulator which is busy in another. */
 static void _notifier_call_chain(struct regulator_dev *rdev,
 				  unsigned long event, void *data)
 {
-	struct regulator_dev *_rdev;
+	struct regulator_dev *_rdev = rdev;
 
-	/* call rdev chain first */
-	mutex_lock(&rdev->mutex);
-	blocking_notifier_call_chain(&rdev->notifier, event, NULL);
-	mutex_unlock(&rdev->mutex);
+	rdev_event_log(rdev, REGULATOR_RECORD_EVENT, event);
+
+	for (;;) {
+		rdev_notify(_rdev, event);
+
+		/* down to the first regulator we supply... */
+		if (!list_empty(&_rdev->supply_list)) {
+			_rdev = list_first_entry(&_rdev->supply_list,
+						 struct regulator_dev, slist);
+			continue;
+		}
 
-	/* now notify regulator we supply */
-	list_for_each_entry(_rdev, &rdev->supply_list, slist)
-		_notifier_call_chain(_rdev, event, data);
+		/* ...or across to the next sibling, climbing back up
+		 * past any finished subtrees */
+		while (_rdev != rdev &&
+		       _rdev->slist.next == &_rdev->supply->supply_list)
+			_rdev = _rdev->supply;
+		if (_rdev == rdev)
+			break;
+		_rdev = list_entry(_rdev->slist.next, struct regulator_dev,
+				   slist);
+	}
 }
 
 /**
@@ -1582,9 +3712,11 @@ int regulator_bulk_get(struct device *dev, int num_consumers,
 	for (i = 0; i < num_consumers; i++)
 		consumers[i].consumer = NULL;
 
+	/* resolve all the supplies in a single pass over the map */
+	down_read(&regulator_map_sem);
 	for (i = 0; i < num_consumers; i++) {
-		consumers[i].consumer = regulator_get(dev,
-						      consumers[i].supply);
+		consumers[i].consumer = _regulator_get(dev,
+						       consumers[i].supply);
 		if (IS_ERR(consumers[i].consumer)) {
 			dev_err(dev, "Failed to get supply '%s'\n",
 				consumers[i].supply);
@@ -1593,10 +3725,12 @@ int regulator_bulk_get(struct device *dev, int num_consumers,
 			goto err;
 		}
 	}
+	up_read(&regulator_map_sem);
 
 	return 0;
 
 err:
+	up_read(&regulator_map_sem);
 	for (i = 0; i < num_consumers && consumers[i].consumer; i++)
 		regulator_put(consumers[i].consumer);
 
@@ -1604,6 +3738,109 @@ err:
 }
 EXPORT_SYMBOL_GPL(regulator_bulk_get);
 
+/* the device whose I/O the regulator shares with its siblings, the PMIC */
+static struct device *rdev_get_pmic(struct regulator_dev *rdev)
+{
+	struct device *dev = rdev->dev.parent;
+
+	if (rdev->desc->parent_pmic && dev->parent)
+		return dev->parent;
+	return dev;
+}
+
+static struct regulator_dev *rdev_get_root(struct regulator_dev *rdev)
+{
+	if (rdev->depth)
+		return rdev->supplies[rdev->depth - 1];
+	return rdev;
+}
+
+/* Regulators sharing a supply chain must be enabled in sequence since the
+ * supplies are updated as we go.  Regulators on the same PMIC are too, as
+ * nothing is gained from queueing I/O for the same device. */
+static int regulator_bulk_dependent(struct regulator_dev *a,
+				    struct regulator_dev *b)
+{
+	return rdev_get_root(a) == rdev_get_root(b) ||
+		rdev_get_pmic(a) == rdev_get_pmic(b);
+}
+
+/* Partition the consumers into groups of dependent supplies, labelling
+ * each with the index of a member.  Returns the number of groups. */
+static int regulator_bulk_group(int num_consumers,
+				struct regulator_bulk_data *consumers,
+				int *group)
+{
+	int i, j, k, old, groups = 0;
+
+	for (i = 0; i < num_consumers; i++) {
+		group[i] = i;
+		for (j = 0; j < i; j++) {
+			if (group[j] == group[i])
+				continue;
+			if (!regulator_bulk_dependent(consumers[i].consumer->rdev,
+						      consumers[j].consumer->rdev))
+				continue;
+
+			/* merge the group of i into the group of j */
+			old = group[i];
+			for (k = 0; k <= i; k++)
+				if (group[k] == old)
+					group[k] = group[j];
+		}
+	}
+
+	for (i = 0; i < num_consumers; i++)
+		if (group[i] == i)
+			groups++;
+
+	return groups;
+}
+
+/* The online CPU after @cpu, for spreading work which should run
+ * concurrently.  get_online_cpus() held by caller */
+static int regulator_next_cpu(int cpu)
+{
+	cpu = next_cpu_nr(cpu, cpu_online_map);
+	if (cpu >= nr_cpu_ids)
+		cpu = first_cpu(cpu_online_map);
+	return cpu;
+}
+
+/* Enable a group of consumers in order, or all of them if group is NULL.
+ * Stops at the first failure and leaves the result for each consumer in
+ * result. */
+static void regulator_bulk_enable_group(int num_consumers,
+					struct regulator_bulk_data *consumers,
+					int *group, int id, int *result)
+{
+	int i, ret = 0;
+
+	for (i = 0; i < num_consumers; i++) {
+		if (group && group[i] != id)
+			continue;
+
+		if (ret == 0) {
+			ret = regulator_enable(consumers[i].consumer);
+			result[i] = ret;
+		} else {
+			result[i] = -ECANCELED;
+		}
+	}
+}
+
+static void regulator_bulk_enable_work(struct work_struct *work)
+{
+	struct regulator_bulk_work *bulk =
+		container_of(work, struct regulator_bulk_work, work);
+
+	regulator_bulk_enable_group(bulk->num_consumers, bulk->consumers,
+				    bulk->group, bulk->id, bulk->result);
+
+	if (atomic_dec_and_test(bulk->pending))
+		complete(bulk->done);
+}
+
 /**
  * regulator_bulk_enable - enable multiple regulator consumers
  *
@@ -1615,26 +3852,98 @@ EXPORT_SYMBOL_GPL(regulator_bulk_get);
  * clients in a single API call.  If any consumers cannot be enabled
  * then any others that were enabled will be disabled again prior to
  * return.
+ *
+ * Supplies which do not share a supply chain or a PMIC are enabled in
+ * parallel, supplies which do are enabled in the order given.
  */
 int regulator_bulk_enable(int num_consumers,
 			  struct regulator_bulk_data *consumers)
 {
-	int i;
-	int ret;
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct regulator_bulk_work *work = NULL;
+	atomic_t pending;
+	int *group, *result;
+	int i, n, cpu, groups;
+	int ret = 0;
+
+	/* a result and a group label for each consumer */
+	result = kcalloc(num_consumers * 2, sizeof(int), GFP_KERNEL);
+	if (!result) {
+		for (i = 0; i < num_consumers; i++) {
+			ret = regulator_enable(consumers[i].consumer);
+			if (ret != 0)
+				break;
+		}
+		if (ret == 0)
+			return 0;
+
+		printk(KERN_ERR "Failed to enable %s: %d\n",
+		       consumers[i].supply, ret);
+		while (--i >= 0)
+			regulator_disable(consumers[i].consumer);
+		return ret;
+	}
+	group = result + num_consumers;
+
+	groups = regulator_bulk_group(num_consumers, consumers, group);
+	if (groups > 1 && regulator_parallel_wq)
+		work = kcalloc(groups - 1, sizeof(*work), GFP_KERNEL);
+
+	if (!work) {
+		/* nothing to parallelise, or no memory to do it with */
+		regulator_bulk_enable_group(num_consumers, consumers, NULL, 0,
+					    result);
+		goto out;
+	}
 
+	/* hand every group but our own to the workqueue, spread over the
+	 * online CPUs so they really do run concurrently */
+	atomic_set(&pending, groups - 1);
+	get_online_cpus();
+	cpu = raw_smp_processor_id();
+	n = 0;
 	for (i = 0; i < num_consumers; i++) {
-		ret = regulator_enable(consumers[i].consumer);
-		if (ret != 0)
-			goto err;
+		if (group[i] != i || i == group[0])
+			continue;
+
+		work[n].consumers = consumers;
+		work[n].num_consumers = num_consumers;
+		work[n].group = group;
+		work[n].result = result;
+		work[n].id = i;
+		work[n].pending = &pending;
+		work[n].done = &done;
+		INIT_WORK(&work[n].work, regulator_bulk_enable_work);
+
+		cpu = regulator_next_cpu(cpu);
+		queue_work_on(cpu, regulator_parallel_wq, &work[n].work);
+		n++;
 	}
+	put_online_cpus();
 
-	return 0;
+	regulator_bulk_enable_group(num_consumers, consumers, group,
+				    group[0], result);
+	wait_for_completion(&done);
 
-err:
-	printk(KERN_ERR "Failed to enable %s\n", consumers[i].supply);
-	for (i = 0; i < num_consumers; i++)
-		regulator_disable(consumers[i].consumer);
+out:
+	kfree(work);
 
+	/* report the first failure and roll back everything we enabled */
+	for (i = 0; i < num_consumers; i++) {
+		if (result[i] != 0) {
+			ret = result[i];
+			printk(KERN_ERR "Failed to enable %s: %d\n",
+			       consumers[i].supply, ret);
+			break;
+		}
+	}
+
+	if (ret != 0)
+		for (i = 0; i < num_consumers; i++)
+			if (result[i] == 0)
+				regulator_disable(consumers[i].consumer);
+
+	kfree(result);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_bulk_enable);
@@ -1702,7 +4011,8 @@ EXPORT_SYMBOL_GPL(regulator_bulk_free);
  * @data:
  *
  * Called by regulator drivers to notify clients a regulator event has
- * occurred. We also notify regulator clients downstream.
+ * occurred. We also notify regulator clients downstream.  No regulator
+ * locks are taken so this may be called with rdev->mutex held.
  */
 int regulator_notifier_call_chain(struct regulator_dev *rdev,
 				  unsigned long event, void *data)
@@ -1715,18 +4025,20 @@ EXPORT_SYMBOL_GPL(regulator_notifier_call_chain);
 
 /**
  * regulator_register - register regulator
- * @regulator: regulator source
- * @reg_data: private regulator data
+ * @regulator_desc: regulator to register
+ * @dev: struct device for the regulator
+ * @init_data: platform provided init data, usually dev->platform_data
+ * @driver_data: private regulator data
  *
  * Called by regulator drivers to register a regulator.
  * Returns 0 on success.
  */
 struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
-	struct device *dev, void *driver_data)
+	struct device *dev, struct regulator_init_data *init_data,
+	void *driver_data)
 {
 	static atomic_t regulator_no = ATOMIC_INIT(0);
 	struct regulator_dev *rdev;
-	struct regulator_init_data *init_data = dev->platform_data;
 	int ret, i;
 
 	if (regulator_desc == NULL)
@@ -1749,6 +4061,8 @@ struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
 	mutex_lock(&regulator_list_mutex);
 
 	mutex_init(&rdev->mutex);
+	seqlock_init(&rdev->cache_lock);
+	spin_lock_init(&rdev->atomic_lock);
 	rdev->reg_data = driver_data;
 	rdev->owner = regulator_desc->owner;
 	rdev->desc = regulator_desc;
@@ -1757,6 +4071,9 @@ struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
 	INIT_LIST_HEAD(&rdev->list);
 	INIT_LIST_HEAD(&rdev->slist);
 	BLOCKING_INIT_NOTIFIER_HEAD(&rdev->notifier);
+	INIT_DELAYED_WORK(&rdev->drms_work, drms_work);
+	INIT_DELAYED_WORK(&rdev->disable_work, regulator_disable_work);
+	rdev->energy_time = ktime_get();
 
 	/* preform any regulator specific init */
 	if (init_data->regulator_init) {
@@ -1779,10 +4096,12 @@ struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
 	/* register with sysfs */
 	rdev->dev.class = &regulator_class;
 	rdev->dev.parent = dev;
+	rdev->num = atomic_inc_return(&regulator_no) - 1;
 	snprintf(rdev->dev.bus_id, sizeof(rdev->dev.bus_id),
-		 "regulator.%d", atomic_inc_return(&regulator_no) - 1);
+		 "regulator.%d", rdev->num);
 	ret = device_register(&rdev->dev);
 	if (ret != 0) {
+		kfree(rdev->voltages);
 		kfree(rdev);
 		rdev = ERR_PTR(ret);
 		goto out;
@@ -1808,9 +4127,7 @@ struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
 			init_data->consumer_supplies[i].dev,
 			init_data->consumer_supplies[i].supply);
 		if (ret < 0) {
-			for (--i; i >= 0; i--)
-				unset_consumer_device_supply(rdev,
-					init_data->consumer_supplies[i].dev);
+			unset_regulator_supplies(rdev);
 			device_unregister(&rdev->dev);
 			kfree(rdev);
 			rdev = ERR_PTR(ret);
@@ -1818,6 +4135,7 @@ struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
 		}
 	}
 
+	rdev_init_debugfs(rdev);
 	list_add(&rdev->list, &regulator_list);
 out:
 	mutex_unlock(&regulator_list_mutex);
@@ -1836,25 +4154,99 @@ void regulator_unregister(struct regulator_dev *rdev)
 	if (rdev == NULL)
 		return;
 
+	cancel_delayed_work_sync(&rdev->drms_work);
+	cancel_delayed_work_sync(&rdev->disable_work);
+
+	/* finish a deferred disable now so its supply reference is dropped,
+	 * even if the output itself can't be turned off */
+	mutex_lock(&rdev->mutex);
+	if (rdev->disable_pending) {
+		_regulator_do_disable(rdev);
+		rdev->disable_pending = 0;
+		rdev_put_supplies(rdev, 0, 0);
+	}
+	mutex_unlock(&rdev->mutex);
+
 	mutex_lock(&regulator_list_mutex);
+	unset_regulator_supplies(rdev);
 	list_del(&rdev->list);
-	if (rdev->supply)
+	if (rdev->supply) {
+		list_del(&rdev->slist);
 		sysfs_remove_link(&rdev->dev.kobj, "supply");
+	}
+	rdev_exit_debugfs(rdev);
 	device_unregister(&rdev->dev);
 	mutex_unlock(&regulator_list_mutex);
 }
 EXPORT_SYMBOL_GPL(regulator_unregister);
 
+static int regulator_suspend_one(struct regulator_dev *rdev,
+				 suspend_state_t state)
+{
+	int ret;
+
+	mutex_lock(&rdev->mutex);
+	ret = suspend_prepare(rdev, state);
+	mutex_unlock(&rdev->mutex);
+
+	if (ret < 0)
+		printk(KERN_ERR "%s: failed to prepare %s\n",
+			__func__, rdev->desc->name);
+	return ret;
+}
+
+/* Prepare a group of regulators in order, or all of them if group is NULL.
+ * Stops at the first failure. */
+static int regulator_suspend_group(struct regulator_dev **rdevs,
+				   int num_rdevs, int *group, int id,
+				   suspend_state_t state)
+{
+	int i, ret;
+
+	for (i = 0; i < num_rdevs; i++) {
+		if (group && group[i] != id)
+			continue;
+
+		ret = regulator_suspend_one(rdevs[i], state);
+		if (ret < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+static void regulator_suspend_work(struct work_struct *work)
+{
+	struct regulator_suspend_work *suspend =
+		container_of(work, struct regulator_suspend_work, work);
+
+	suspend->ret = regulator_suspend_group(suspend->rdevs,
+					       suspend->num_rdevs,
+					       suspend->group, suspend->id,
+					       suspend->state);
+
+	if (atomic_dec_and_test(suspend->pending))
+		complete(suspend->done);
+}
+
 /**
  * regulator_suspend_prepare: prepare regulators for system wide suspend
  * @state: system suspend state
  *
  * Configure each regulator with it's suspend operating parameters for state.
  * This will usually be called by machine suspend code prior to supending.
+ *
+ * Only settings which differ from those last written are programmed, and
+ * regulators on different PMICs are programmed in parallel.
  */
 int regulator_suspend_prepare(suspend_state_t state)
 {
-	struct regulator_dev *rdev;
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct regulator_suspend_work *work = NULL;
+	struct regulator_dev **rdevs, *rdev;
+	atomic_t pending;
+	int *group;
+	int i, j, n, cpu, num_rdevs = 0, groups = 0;
 	int ret = 0;
 
 	/* ON is handled by regulator active state */
@@ -1862,20 +4254,81 @@ int regulator_suspend_prepare(suspend_state_t state)
 		return -EINVAL;
 
 	mutex_lock(&regulator_list_mutex);
+	list_for_each_entry(rdev, &regulator_list, list)
+		num_rdevs++;
+
+	rdevs = kcalloc(num_rdevs, sizeof(*rdevs), GFP_KERNEL);
+	group = kcalloc(num_rdevs, sizeof(int), GFP_KERNEL);
+	if (!rdevs || !group) {
+		/* no memory to parallelise, do them in turn */
+		list_for_each_entry(rdev, &regulator_list, list) {
+			ret = regulator_suspend_one(rdev, state);
+			if (ret < 0)
+				break;
+		}
+		goto out;
+	}
+
+	/* group the regulators by PMIC, labelling each group with the index
+	 * of its first member */
+	i = 0;
 	list_for_each_entry(rdev, &regulator_list, list) {
+		rdevs[i] = rdev;
+		group[i] = i;
+		for (j = 0; j < i; j++) {
+			if (rdev_get_pmic(rdevs[j]) == rdev_get_pmic(rdev)) {
+				group[i] = group[j];
+				break;
+			}
+		}
+		if (group[i] == i)
+			groups++;
+		i++;
+	}
 
-		mutex_lock(&rdev->mutex);
-		ret = suspend_prepare(rdev, state);
-		mutex_unlock(&rdev->mutex);
+	if (groups > 1 && regulator_parallel_wq)
+		work = kcalloc(groups - 1, sizeof(*work), GFP_KERNEL);
+	if (!work) {
+		ret = regulator_suspend_group(rdevs, num_rdevs, NULL, 0, state);
+		goto out;
+	}
 
-		if (ret < 0) {
-			printk(KERN_ERR "%s: failed to prepare %s\n",
-				__func__, rdev->desc->name);
-			goto out;
-		}
+	/* hand every PMIC but the first to the workqueue and wait for them
+	 * all together */
+	atomic_set(&pending, groups - 1);
+	get_online_cpus();
+	cpu = raw_smp_processor_id();
+	n = 0;
+	for (i = 1; i < num_rdevs; i++) {
+		if (group[i] != i)
+			continue;
+
+		work[n].rdevs = rdevs;
+		work[n].num_rdevs = num_rdevs;
+		work[n].group = group;
+		work[n].id = i;
+		work[n].state = state;
+		work[n].pending = &pending;
+		work[n].done = &done;
+		INIT_WORK(&work[n].work, regulator_suspend_work);
+
+		cpu = regulator_next_cpu(cpu);
+		queue_work_on(cpu, regulator_parallel_wq, &work[n].work);
+		n++;
 	}
+	put_online_cpus();
+
+	ret = regulator_suspend_group(rdevs, num_rdevs, group, 0, state);
+	wait_for_completion(&done);
+
+	for (n = 0; n < groups - 1 && ret == 0; n++)
+		ret = work[n].ret;
+
 out:
 	mutex_unlock(&regulator_list_mutex);
+	kfree(work);
+	kfree(group);
+	kfree(rdevs);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(regulator_suspend_prepare);
@@ -1939,9 +4392,147 @@ void *regulator_get_init_drvdata(struct regulator_init_data *reg_init_data)
 }
 EXPORT_SYMBOL_GPL(regulator_get_init_drvdata);
 
+#ifdef CONFIG_REGULATOR_EVENTS
+/* position of one reader in the event ring */
+struct regulator_event_reader {
+	unsigned long seq;
+};
+
+static int regulator_event_pending(struct regulator_event_reader *reader)
+{
+	return reader->seq != ACCESS_ONCE(regulator_event_head);
+}
+
+/* Copy up to max waiting records for reader, oldest first, returning the
+ * number copied */
+static int regulator_event_fetch(struct regulator_event_reader *reader,
+				 struct regulator_event_record *recs, int max)
+{
+	unsigned long waiting, lost = 0;
+	int i;
+
+	spin_lock_irq(&regulator_event_lock);
+	waiting = regulator_event_head - reader->seq;
+	if (waiting > REGULATOR_EVENT_RING) {
+		lost = waiting - REGULATOR_EVENT_RING;
+		reader->seq += lost;
+		waiting = REGULATOR_EVENT_RING;
+	}
+	for (i = 0; i < waiting && i < max; i++)
+		recs[i] = regulator_event_ring[reader->seq++ &
+					      (REGULATOR_EVENT_RING - 1)];
+	spin_unlock_irq(&regulator_event_lock);
+
+	if (i && lost)
+		recs[0].lost = min_t(unsigned long, lost, 0xffff);
+
+	return i;
+}
+
+static int regulator_event_open(struct inode *inode, struct file *file)
+{
+	struct regulator_event_reader *reader;
+
+	reader = kmalloc(sizeof(*reader), GFP_KERNEL);
+	if (reader == NULL)
+		return -ENOMEM;
+
+	/* readers only see what happens after they open the device */
+	spin_lock_irq(&regulator_event_lock);
+	reader->seq = regulator_event_head;
+	spin_unlock_irq(&regulator_event_lock);
+
+	file->private_data = reader;
+	return 0;
+}
+
+static int regulator_event_release(struct inode *inode, struct file *file)
+{
+	kfree(file->private_data);
+	return 0;
+}
+
+static ssize_t regulator_event_read(struct file *file, char __user *buf,
+				    size_t count, loff_t *ppos)
+{
+	struct regulator_event_reader *reader = file->private_data;
+	struct regulator_event_record recs[16];
+	size_t done = 0;
+	int n, ret;
+
+	if (count < sizeof(recs[0]))
+		return -EINVAL;
+
+	if (file->f_flags & O_NONBLOCK) {
+		if (!regulator_event_pending(reader))
+			return -EAGAIN;
+	} else {
+		ret = wait_event_interruptible(regulator_event_wait,
+					       regulator_event_pending(reader));
+		if (ret)
+			return ret;
+	}
+
+	/* hand back everything waiting which fits */
+	while (count - done >= sizeof(recs[0])) {
+		n = min_t(size_t, ARRAY_SIZE(recs),
+			  (count - done) / sizeof(recs[0]));
+		n = regulator_event_fetch(reader, recs, n);
+		if (!n)
+			break;
+
+		if (copy_to_user(buf + done, recs, n * sizeof(recs[0])))
+			return -EFAULT;
+		done += n * sizeof(recs[0]);
+	}
+
+	return done;
+}
+
+static unsigned int regulator_event_poll(struct file *file, poll_table *wait)
+{
+	poll_wait(file, &regulator_event_wait, wait);
+
+	if (regulator_event_pending(file->private_data))
+		return POLLIN | POLLRDNORM;
+	return 0;
+}
+
+static const struct file_operations regulator_event_fops = {
+	.owner = THIS_MODULE,
+	.open = regulator_event_open,
+	.release = regulator_event_release,
+	.read = regulator_event_read,
+	.poll = regulator_event_poll,
+};
+
+static struct miscdevice regulator_event_dev = {
+	.minor = MISC_DYNAMIC_MINOR,
+	.name = "regulator_events",
+	.fops = &regulator_event_fops,
+};
+
+/* the misc class is not available as early as regulator_init() */
+static int __init regulator_event_init(void)
+{
+	return misc_register(&regulator_event_dev);
+}
+device_initcall(regulator_event_init);
+#endif
+
 static int __init regulator_init(void)
 {
 	printk(KERN_INFO "regulator: core version %s\n", REGULATOR_VERSION);
+
+	regulator_wq = create_workqueue("regulator");
+	if (regulator_wq == NULL)
+		return -ENOMEM;
+
+	/* without it bulk operations just run serially */
+	regulator_parallel_wq = create_workqueue("regulator_par");
+
+	regulator_debugfs_init();
+
 	return class_register(&regulator_class);
 }
 
@@ -18,22 +18,56 @@
 #include <linux/err.h>
 #include <linux/mutex.h>
 #include <linux/platform_device.h>
+#include <linux/gpio.h>
 #include <linux/regulator/driver.h>
+#include <linux/regulator/machine.h>
 #include <linux/regulator/fixed.h>
 
 struct fixed_voltage_data {
 	struct regulator_desc desc;
 	struct regulator_dev *dev;
 	int microvolts;
+	int gpio;
+	int enable_high;
+	int is_enabled;
 };
 
+static void fixed_voltage_set_gpio(struct fixed_voltage_data *data, int on)
+{
+	int val = on ? data->enable_high : !data->enable_high;
+
+	/* atomic regulators may be switched with interrupts disabled */
+	if (data->desc.atomic)
+		gpio_set_value(data->gpio, val);
+	else
+		gpio_set_value_cansleep(data->gpio, val);
+	data->is_enabled = on;
+}
+
 static int fixed_voltage_is_enabled(struct regulator_dev *dev)
 {
-	return 1;
+	struct fixed_voltage_data *data = rdev_get_drvdata(dev);
+
+	return data->is_enabled;
 }
 
 static int fixed_voltage_enable(struct regulator_dev *dev)
 {
+	struct fixed_voltage_data *data = rdev_get_drvdata(dev);
+
+	if (gpio_is_valid(data->gpio))
+		fixed_voltage_set_gpio(data, 1);
+
+	return 0;
+}
+
+static int fixed_voltage_disable(struct regulator_dev *dev)
+{
+	struct fixed_voltage_data *data = rdev_get_drvdata(dev);
+
+	if (gpio_is_valid(data->gpio))
+		fixed_voltage_set_gpio(data, 0);
+
 	return 0;
 }
 
@@ -47,6 +81,7 @@ static int fixed_voltage_get_voltage(struct regulator_dev *dev)
 static struct regulator_ops fixed_voltage_ops = {
 	.is_enabled = fixed_voltage_is_enabled,
 	.enable = fixed_voltage_enable,
+	.disable = fixed_voltage_disable,
 	.get_voltage = fixed_voltage_get_voltage,
 };
 
@@ -56,6 +91,9 @@ static int regulator_fixed_voltage_probe(struct platform_device *pdev)
 	struct fixed_voltage_data *drvdata;
 	int ret;
 
+	if (!config || !config->init_data)
+		return -EINVAL;
+
 	drvdata = kzalloc(sizeof(struct fixed_voltage_data), GFP_KERNEL);
 	if (drvdata == NULL) {
 		ret = -ENOMEM;
@@ -69,14 +107,46 @@ static int regulator_fixed_voltage_probe(struct platform_device *pdev)
 	}
 	drvdata->desc.type = REGULATOR_VOLTAGE;
 	drvdata->desc.owner = THIS_MODULE;
-	drvdata->desc.ops = &fixed_voltage_ops,
+	drvdata->desc.ops = &fixed_voltage_ops;
 
 	drvdata->microvolts = config->microvolts;
 
-	drvdata->dev = regulator_register(&drvdata->desc, drvdata);
+	/* without a GPIO the supply is always on */
+	drvdata->gpio = config->has_gpio ? config->gpio : -EINVAL;
+	drvdata->enable_high = config->enable_high;
+	drvdata->is_enabled = 1;
+	if (gpio_is_valid(drvdata->gpio)) {
+		ret = gpio_request(drvdata->gpio, config->supply_name);
+		if (ret) {
+			dev_err(&pdev->dev, "Failed to request GPIO %d: %d\n",
+				drvdata->gpio, ret);
+			goto err_name;
+		}
+
+		drvdata->is_enabled = config->enabled_at_boot;
+		ret = gpio_direction_output(drvdata->gpio,
+			drvdata->is_enabled ? config->enable_high :
+			!config->enable_high);
+		if (ret) {
+			dev_err(&pdev->dev, "Failed to set GPIO %d: %d\n",
+				drvdata->gpio, ret);
+			goto err_gpio;
+		}
+	} else if (config->has_gpio) {
+		dev_err(&pdev->dev, "Invalid enable GPIO %d\n", config->gpio);
+		ret = -EINVAL;
+		goto err_name;
+	}
+
+	/* GPIOs on the SoC can be switched from atomic context */
+	drvdata->desc.atomic = !gpio_is_valid(drvdata->gpio) ||
+		!gpio_cansleep(drvdata->gpio);
+
+	drvdata->dev = regulator_register(&drvdata->desc, &pdev->dev,
+					  config->init_data, drvdata);
 	if (IS_ERR(drvdata->dev)) {
 		ret = PTR_ERR(drvdata->dev);
-		goto err_name;
+		goto err_gpio;
 	}
 
 	platform_set_drvdata(pdev, drvdata);
@@ -86,6 +156,9 @@ static int regulator_fixed_voltage_probe(struct platform_device *pdev)
 
 	return 0;
 
+err_gpio:
+	if (gpio_is_valid(drvdata->gpio))
+		gpio_free(drvdata->gpio);
 err_name:
 	kfree(drvdata->desc.name);
 err:
@@ -98,6 +171,8 @@ static int regulator_fixed_voltage_remove(struct platform_device *pdev)
 	struct fixed_voltage_data *drvdata = platform_get_drvdata(pdev);
 
 	regulator_unregister(drvdata->dev);
+	if (gpio_is_valid(drvdata->gpio))
+		gpio_free(drvdata->gpio);
 	kfree(drvdata->desc.name);
 	kfree(drvdata);
 
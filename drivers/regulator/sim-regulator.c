@@ -0,0 +1,306 @@
+/*
+ * sim-regulator.c  --  Simulated PMIC for exercising the regulator core
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Registers a number of regulators backed by variables rather than
+ * hardware, each register access taking a configurable time to simulate
+ * the bus.  Rails are chained so that every rail whose number is not a
+ * multiple of chain is supplied by the one before it, and each rail simN
+ * is available to consumers without a device as supply "simN".
+ *
+ * e.g. modprobe sim-regulator rails=8 chain=2 latency_us=200
+ */
+
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/err.h>
+#include <linux/delay.h>
+#include <linux/sched.h>
+#include <linux/platform_device.h>
+#include <linux/regulator/driver.h>
+#include <linux/regulator/machine.h>
+
+static int rails = 4;
+module_param(rails, int, 0444);
+MODULE_PARM_DESC(rails, "Number of regulators");
+
+static int chain = 1;
+module_param(chain, int, 0444);
+MODULE_PARM_DESC(chain, "Length of each supply chain, 1 for none");
+
+static int latency_us;
+module_param(latency_us, int, 0444);
+MODULE_PARM_DESC(latency_us, "Time taken by each register access");
+
+static int ramp_delay;
+module_param(ramp_delay, int, 0444);
+MODULE_PARM_DESC(ramp_delay, "Voltage slew rate in uV/us, 0 for instant");
+
+static int enable_time;
+module_param(enable_time, int, 0444);
+MODULE_PARM_DESC(enable_time, "Time in us for the output to settle");
+
+static int cache = 1;
+module_param(cache, int, 0444);
+MODULE_PARM_DESC(cache, "Allow the core to cache the regulator state");
+
+#define SIM_MIN_UV	600000
+#define SIM_STEP_UV	12500
+#define SIM_SELECTORS	256
+
+static const struct regulator_linear_range sim_ranges[] = {
+	{ .min_sel = 0, .max_sel = SIM_SELECTORS - 1, .min_uV = SIM_MIN_UV,
+	  .uV_step = SIM_STEP_UV },
+};
+
+struct sim_rail {
+	struct regulator_desc desc;
+	struct regulator_init_data init_data;
+	struct regulator_consumer_supply supply;
+	struct platform_device *pdev;
+	char name[16];
+
+	/* simulated registers */
+	int enabled;
+	unsigned selector;
+	unsigned int mode;
+};
+
+static struct sim_rail *sim_rails;
+
+/* Pay for one register access */
+static void sim_access(void)
+{
+	if (!latency_us)
+		return;
+
+	if (latency_us < 20)
+		udelay(latency_us);
+	else
+		schedule_timeout_uninterruptible(usecs_to_jiffies(latency_us));
+}
+
+static int sim_enable(struct regulator_dev *rdev)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	rail->enabled = 1;
+	return 0;
+}
+
+static int sim_disable(struct regulator_dev *rdev)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	rail->enabled = 0;
+	return 0;
+}
+
+static int sim_is_enabled(struct regulator_dev *rdev)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	return rail->enabled;
+}
+
+static int sim_set_voltage_sel(struct regulator_dev *rdev, unsigned selector)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	rail->selector = selector;
+	return 0;
+}
+
+static int sim_get_voltage_sel(struct regulator_dev *rdev)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	return rail->selector;
+}
+
+static int sim_set_mode(struct regulator_dev *rdev, unsigned int mode)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	rail->mode = mode;
+	return 0;
+}
+
+static unsigned int sim_get_mode(struct regulator_dev *rdev)
+{
+	struct sim_rail *rail = rdev_get_drvdata(rdev);
+
+	sim_access();
+	return rail->mode;
+}
+
+static unsigned int sim_get_optimum_mode(struct regulator_dev *rdev,
+					 int input_uV, int output_uV,
+					 int load_uA)
+{
+	if (load_uA > 100000)
+		return REGULATOR_MODE_FAST;
+	if (load_uA > 10000)
+		return REGULATOR_MODE_NORMAL;
+	return REGULATOR_MODE_IDLE;
+}
+
+static struct regulator_ops sim_ops = {
+	.enable = sim_enable,
+	.disable = sim_disable,
+	.is_enabled = sim_is_enabled,
+	.set_voltage_sel = sim_set_voltage_sel,
+	.get_voltage_sel = sim_get_voltage_sel,
+	.set_mode = sim_set_mode,
+	.get_mode = sim_get_mode,
+	.get_optimum_mode = sim_get_optimum_mode,
+};
+
+static int sim_regulator_probe(struct platform_device *pdev)
+{
+	struct sim_rail *rail = &sim_rails[pdev->id];
+	struct regulator_dev *rdev;
+
+	rdev = regulator_register(&rail->desc, &pdev->dev, &rail->init_data,
+				  rail);
+	if (IS_ERR(rdev)) {
+		dev_err(&pdev->dev, "failed to register %s: %ld\n",
+			rail->name, PTR_ERR(rdev));
+		return PTR_ERR(rdev);
+	}
+
+	platform_set_drvdata(pdev, rdev);
+	return 0;
+}
+
+static int sim_regulator_remove(struct platform_device *pdev)
+{
+	struct regulator_dev *rdev = platform_get_drvdata(pdev);
+
+	regulator_unregister(rdev);
+	return 0;
+}
+
+static struct platform_driver sim_regulator_driver = {
+	.probe = sim_regulator_probe,
+	.remove = sim_regulator_remove,
+	.driver = {
+		.name = "sim-regulator",
+	},
+};
+
+static void sim_rail_init(struct sim_rail *rail, int id)
+{
+	struct regulation_constraints *c = &rail->init_data.constraints;
+
+	snprintf(rail->name, sizeof(rail->name), "sim%d", id);
+	rail->mode = REGULATOR_MODE_NORMAL;
+
+	rail->desc.name = rail->name;
+	rail->desc.id = id;
+	rail->desc.ops = &sim_ops;
+	rail->desc.type = REGULATOR_VOLTAGE;
+	rail->desc.owner = THIS_MODULE;
+	rail->desc.n_voltages = SIM_SELECTORS;
+	rail->desc.linear_ranges = sim_ranges;
+	rail->desc.n_linear_ranges = ARRAY_SIZE(sim_ranges);
+	rail->desc.ramp_delay = ramp_delay;
+	rail->desc.enable_time = enable_time;
+	if (cache)
+		rail->desc.cache_flags = REGULATOR_CACHE_VOLTAGE |
+			REGULATOR_CACHE_MODE | REGULATOR_CACHE_STATUS;
+
+	c->min_uV = SIM_MIN_UV;
+	c->max_uV = SIM_MIN_UV + (SIM_SELECTORS - 1) * SIM_STEP_UV;
+	c->valid_modes_mask = REGULATOR_MODE_FAST | REGULATOR_MODE_NORMAL |
+		REGULATOR_MODE_IDLE | REGULATOR_MODE_STANDBY;
+	c->valid_ops_mask = REGULATOR_CHANGE_VOLTAGE |
+		REGULATOR_CHANGE_STATUS | REGULATOR_CHANGE_MODE |
+		REGULATOR_CHANGE_DRMS;
+
+	rail->supply.supply = rail->name;
+	rail->init_data.num_consumer_supplies = 1;
+	rail->init_data.consumer_supplies = &rail->supply;
+}
+
+static void sim_regulator_cleanup(int num)
+{
+	while (--num >= 0)
+		platform_device_unregister(sim_rails[num].pdev);
+	platform_driver_unregister(&sim_regulator_driver);
+	kfree(sim_rails);
+}
+
+static int __init sim_regulator_init(void)
+{
+	struct sim_rail *rail;
+	int i, ret;
+
+	if (rails <= 0 || chain <= 0)
+		return -EINVAL;
+
+	sim_rails = kzalloc(rails * sizeof(*sim_rails), GFP_KERNEL);
+	if (sim_rails == NULL)
+		return -ENOMEM;
+
+	ret = platform_driver_register(&sim_regulator_driver);
+	if (ret != 0) {
+		kfree(sim_rails);
+		return ret;
+	}
+
+	/* devices are probed as they are added so each supply is
+	 * registered before the rails it supplies */
+	for (i = 0; i < rails; i++) {
+		rail = &sim_rails[i];
+		sim_rail_init(rail, i);
+		if (i % chain)
+			rail->init_data.supply_regulator_dev =
+				&sim_rails[i - 1].pdev->dev;
+
+		rail->pdev = platform_device_alloc("sim-regulator", i);
+		if (rail->pdev == NULL) {
+			ret = -ENOMEM;
+			goto err;
+		}
+		rail->pdev->dev.platform_data = &rail->init_data;
+
+		ret = platform_device_add(rail->pdev);
+		if (ret != 0) {
+			platform_device_put(rail->pdev);
+			goto err;
+		}
+		if (platform_get_drvdata(rail->pdev) == NULL) {
+			platform_device_unregister(rail->pdev);
+			ret = -ENODEV;
+			goto err;
+		}
+	}
+
+	return 0;
+
+err:
+	printk(KERN_ERR "%s: failed to add sim%d: %d\n", __func__, i, ret);
+	sim_regulator_cleanup(i);
+	return ret;
+}
+module_init(sim_regulator_init);
+
+static void __exit sim_regulator_exit(void)
+{
+	sim_regulator_cleanup(rails);
+}
+module_exit(sim_regulator_exit);
+
+MODULE_DESCRIPTION("Simulated PMIC regulators");
+MODULE_LICENSE("GPL");
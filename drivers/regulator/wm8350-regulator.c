@@ -92,28 +92,39 @@ static const int isink_cur[] = {
 	223191
 };
 
+/* pick the highest current in range, isink_cur[] is sorted */
 static int get_isink_val(int min_uA, int max_uA, u16 *setting)
 {
-	int i;
+	int lo = 0, hi = ARRAY_SIZE(isink_cur), mid;
 
-	for (i = ARRAY_SIZE(isink_cur) - 1; i >= 0; i--) {
-		if (min_uA <= isink_cur[i] && max_uA >= isink_cur[i]) {
-			*setting = i;
-			return 0;
-		}
+	/* find the first entry above max_uA */
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (isink_cur[mid] <= max_uA)
+			lo = mid + 1;
+		else
+			hi = mid;
 	}
-	return -EINVAL;
-}
 
-static inline int wm8350_ldo_val_to_mvolts(unsigned int val)
-{
-	if (val < 16)
-		return (val * 50) + 900;
-	else
-		return ((val - 16) * 100) + 1800;
+	if (lo == 0 || isink_cur[lo - 1] < min_uA)
+		return -EINVAL;
 
+	*setting = lo - 1;
+	return 0;
 }
 
+static const struct regulator_linear_range wm8350_dcdc_ranges[] = {
+	{ .min_sel = 0, .max_sel = 127, .min_uV = 850000, .uV_step = 25000 },
+};
+
+/* 50mV steps up to 1.65V then 100mV steps from 1.8V */
+static const struct regulator_linear_range wm8350_ldo_ranges[] = {
+	{ .min_sel = 0, .max_sel = 15, .min_uV = 900000, .uV_step = 50000 },
+	{ .min_sel = 16, .max_sel = 31, .min_uV = 1800000, .uV_step = 100000 },
+};
+
+/* The suspend voltages are set directly from the machine constraints,
+ * which needn't give a voltage table, and are rounded down to a step. */
 static inline unsigned int wm8350_ldo_mvolts_to_val(int mV)
 {
 	if (mV < 1800)
@@ -122,11 +133,6 @@ static inline unsigned int wm8350_ldo_mvolts_to_val(int mV)
 		return ((mV - 1800) / 100) + 16;
 }
 
-static inline int wm8350_dcdc_val_to_mvolts(unsigned int val)
-{
-	return (val * 25) + 850;
-}
-
 static inline unsigned int wm8350_dcdc_mvolts_to_val(int mV)
 {
 	return (mV - 850) / 25;
@@ -311,25 +317,13 @@ int wm8350_isink_set_flash(struct wm8350 *wm8350, int isink, u16 mode,
 }
 EXPORT_SYMBOL_GPL(wm8350_isink_set_flash);
 
-static int wm8350_dcdc_set_voltage(struct regulator_dev *rdev, int min_uV,
-	int max_uV)
+static int wm8350_dcdc_set_voltage_sel(struct regulator_dev *rdev,
+				       unsigned selector)
 {
 	struct wm8350 *wm8350 = rdev_get_drvdata(rdev);
-	int volt_reg, dcdc = rdev_get_id(rdev), mV,
-		min_mV = min_uV / 1000, max_mV = max_uV / 1000;
+	int volt_reg, dcdc = rdev_get_id(rdev);
 	u16 val;
 
-	if (min_mV < 850 || min_mV > 4025)
-		return -EINVAL;
-	if (max_mV < 850 || max_mV > 4025)
-		return -EINVAL;
-
-	/* step size is 25mV */
-	mV = (min_mV - 826) / 25;
-	if (wm8350_dcdc_val_to_mvolts(mV) > max_mV)
-		return -EINVAL;
-	BUG_ON(wm8350_dcdc_val_to_mvolts(mV) < min_mV);
-
 	switch (dcdc) {
 	case WM8350_DCDC_1:
 		volt_reg = WM8350_DCDC1_CONTROL;
@@ -351,11 +345,11 @@ static int wm8350_dcdc_set_voltage(struct regulator_dev *rdev, int min_uV,
 
 	/* all DCDCs have same mV bits */
 	val = wm8350_reg_read(wm8350, volt_reg) & ~WM8350_DC1_VSEL_MASK;
-	wm8350_reg_write(wm8350, volt_reg, val | mV);
+	wm8350_reg_write(wm8350, volt_reg, val | selector);
 	return 0;
 }
 
-static int wm8350_dcdc_get_voltage(struct regulator_dev *rdev)
+static int wm8350_dcdc_get_voltage_sel(struct regulator_dev *rdev)
 {
 	struct wm8350 *wm8350 = rdev_get_drvdata(rdev);
 	int volt_reg, dcdc = rdev_get_id(rdev);
@@ -382,7 +376,7 @@ static int wm8350_dcdc_get_voltage(struct regulator_dev *rdev)
 
 	/* all DCDCs have same mV bits */
 	val = wm8350_reg_read(wm8350, volt_reg) & WM8350_DC1_VSEL_MASK;
-	return wm8350_dcdc_val_to_mvolts(val) * 1000;
+	return val;
 }
 
 static int wm8350_dcdc_set_suspend_voltage(struct regulator_dev *rdev, int uV)
@@ -697,33 +691,13 @@ static int wm8350_ldo_set_suspend_disable(struct regulator_dev *rdev)
 	return 0;
 }
 
-static int wm8350_ldo_set_voltage(struct regulator_dev *rdev, int min_uV,
-	int max_uV)
+static int wm8350_ldo_set_voltage_sel(struct regulator_dev *rdev,
+				      unsigned selector)
 {
 	struct wm8350 *wm8350 = rdev_get_drvdata(rdev);
-	int volt_reg, ldo = rdev_get_id(rdev), mV, min_mV = min_uV / 1000,
-		max_mV = max_uV / 1000;
+	int volt_reg, ldo = rdev_get_id(rdev);
 	u16 val;
 
-	if (min_mV < 900 || min_mV > 3300)
-		return -EINVAL;
-	if (max_mV < 900 || max_mV > 3300)
-		return -EINVAL;
-
-	if (min_mV < 1800) {
-		/* step size is 50mV < 1800mV */
-		mV = (min_mV - 851) / 50;
-		if (wm8350_ldo_val_to_mvolts(mV) > max_mV)
-			return -EINVAL;
-		BUG_ON(wm8350_ldo_val_to_mvolts(mV) < min_mV);
-	} else {
-		/* step size is 100mV > 1800mV */
-		mV = ((min_mV - 1701) / 100) + 16;
-		if (wm8350_ldo_val_to_mvolts(mV) > max_mV)
-			return -EINVAL;
-		BUG_ON(wm8350_ldo_val_to_mvolts(mV) < min_mV);
-	}
-
 	switch (ldo) {
 	case WM8350_LDO_1:
 		volt_reg = WM8350_LDO1_CONTROL;
@@ -743,11 +717,11 @@ static int wm8350_ldo_set_voltage(struct regulator_dev *rdev, int min_uV,
 
 	/* all LDOs have same mV bits */
 	val = wm8350_reg_read(wm8350, volt_reg) & ~WM8350_LDO1_VSEL_MASK;
-	wm8350_reg_write(wm8350, volt_reg, val | mV);
+	wm8350_reg_write(wm8350, volt_reg, val | selector);
 	return 0;
 }
 
-static int wm8350_ldo_get_voltage(struct regulator_dev *rdev)
+static int wm8350_ldo_get_voltage_sel(struct regulator_dev *rdev)
 {
 	struct wm8350 *wm8350 = rdev_get_drvdata(rdev);
 	int volt_reg, ldo = rdev_get_id(rdev);
@@ -772,7 +746,7 @@ static int wm8350_ldo_get_voltage(struct regulator_dev *rdev)
 
 	/* all LDOs have same mV bits */
 	val = wm8350_reg_read(wm8350, volt_reg) & WM8350_LDO1_VSEL_MASK;
-	return wm8350_ldo_val_to_mvolts(val) * 1000;
+	return val;
 }
 
 int wm8350_dcdc_set_slot(struct wm8350 *wm8350, int dcdc, u16 start,
@@ -1091,6 +1065,7 @@ static unsigned int get_mode(int uA, const struct wm8350_dcdc_efficiency *eff)
 	while (eff[i].uA_load_min != -1) {
 		if (uA >= eff[i].uA_load_min && uA <= eff[i].uA_load_max)
 			return eff[i].mode;
+		i++;
 	}
 	return REGULATOR_MODE_NORMAL;
 }
@@ -1147,9 +1122,24 @@ static int wm8350_ldo_is_enabled(struct regulator_dev *rdev)
 	    & (1 << shift);
 }
 
+static int wm8350_regulator_batch_begin(struct regulator_dev *rdev)
+{
+	struct wm8350 *wm8350 = rdev_get_drvdata(rdev);
+
+	wm8350_reg_batch_begin(wm8350);
+	return 0;
+}
+
+static int wm8350_regulator_batch_commit(struct regulator_dev *rdev)
+{
+	struct wm8350 *wm8350 = rdev_get_drvdata(rdev);
+
+	return wm8350_reg_batch_commit(wm8350);
+}
+
 static struct regulator_ops wm8350_dcdc_ops = {
-	.set_voltage = wm8350_dcdc_set_voltage,
-	.get_voltage = wm8350_dcdc_get_voltage,
+	.set_voltage_sel = wm8350_dcdc_set_voltage_sel,
+	.get_voltage_sel = wm8350_dcdc_get_voltage_sel,
 	.enable = wm8350_dcdc_enable,
 	.disable = wm8350_dcdc_disable,
 	.get_mode = wm8350_dcdc_get_mode,
@@ -1160,6 +1150,8 @@ static struct regulator_ops wm8350_dcdc_ops = {
 	.set_suspend_enable = wm8350_dcdc_set_suspend_enable,
 	.set_suspend_disable = wm8350_dcdc_set_suspend_disable,
 	.set_suspend_mode = wm8350_dcdc_set_suspend_mode,
+	.batch_begin = wm8350_regulator_batch_begin,
+	.batch_commit = wm8350_regulator_batch_commit,
 };
 
 static struct regulator_ops wm8350_dcdc2_5_ops = {
@@ -1171,8 +1163,8 @@ static struct regulator_ops wm8350_dcdc2_5_ops = {
 };
 
 static struct regulator_ops wm8350_ldo_ops = {
-	.set_voltage = wm8350_ldo_set_voltage,
-	.get_voltage = wm8350_ldo_get_voltage,
+	.set_voltage_sel = wm8350_ldo_set_voltage_sel,
+	.get_voltage_sel = wm8350_ldo_get_voltage_sel,
 	.enable = wm8350_ldo_enable,
 	.disable = wm8350_ldo_disable,
 	.is_enabled = wm8350_ldo_is_enabled,
@@ -1180,6 +1172,8 @@ static struct regulator_ops wm8350_ldo_ops = {
 	.set_suspend_voltage = wm8350_ldo_set_suspend_voltage,
 	.set_suspend_enable = wm8350_ldo_set_suspend_enable,
 	.set_suspend_disable = wm8350_ldo_set_suspend_disable,
+	.batch_begin = wm8350_regulator_batch_begin,
+	.batch_commit = wm8350_regulator_batch_commit,
 };
 
 static struct regulator_ops wm8350_isink_ops = {
@@ -1198,6 +1192,12 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_DC1,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_DC1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_dcdc_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_dcdc_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_MODE |
+			       REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "DCDC2",
@@ -1206,6 +1206,8 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_DC2,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.cache_flags = REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "DCDC3",
@@ -1214,6 +1216,12 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_DC3,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_DC1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_dcdc_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_dcdc_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_MODE |
+			       REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "DCDC4",
@@ -1222,6 +1230,12 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_DC4,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_DC1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_dcdc_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_dcdc_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_MODE |
+			       REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "DCDC5",
@@ -1230,6 +1244,8 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_DC5,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.cache_flags = REGULATOR_CACHE_STATUS,
 	 },
 	{
 		.name = "DCDC6",
@@ -1238,6 +1254,12 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_DC6,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_DC1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_dcdc_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_dcdc_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_MODE |
+			       REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO1",
@@ -1246,6 +1268,11 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_LDO1,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO2",
@@ -1254,6 +1281,11 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_LDO2,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO3",
@@ -1262,6 +1294,11 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_LDO3,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO4",
@@ -1270,6 +1307,11 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_UV_LDO4,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8350_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8350_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8350_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "ISINKA",
@@ -1278,6 +1320,8 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_CS1,
 		.type = REGULATOR_CURRENT,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.cache_flags = REGULATOR_CACHE_CURRENT,
 	 },
 	{
 		.name = "ISINKB",
@@ -1286,6 +1330,8 @@ static struct regulator_desc wm8350_reg[NUM_WM8350_REGULATORS] = {
 		.irq = WM8350_IRQ_CS2,
 		.type = REGULATOR_CURRENT,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.cache_flags = REGULATOR_CACHE_CURRENT,
 	 },
 };
 
@@ -1336,6 +1382,7 @@ static int wm8350_regulator_probe(struct platform_device *pdev)
 
 	/* register regulator */
 	rdev = regulator_register(&wm8350_reg[pdev->id], &pdev->dev,
+				  pdev->dev.platform_data,
 				  dev_get_drvdata(&pdev->dev));
 	if (IS_ERR(rdev)) {
 		dev_err(&pdev->dev, "failed to register %s\n",
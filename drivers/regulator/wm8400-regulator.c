@@ -43,57 +43,53 @@ static int wm8400_ldo_disable(struct regulator_dev *dev)
 			       WM8400_LDO1_ENA, 0);
 }
 
-static int wm8400_ldo_get_voltage(struct regulator_dev *dev)
+/* Steps of 50mV from 900mV then steps of 100mV from 1700mV */
+static const struct regulator_linear_range wm8400_ldo_ranges[] = {
+	{ .min_sel = 0, .max_sel = 14, .min_uV = 900000, .uV_step = 50000 },
+	{ .min_sel = 15, .max_sel = 31, .min_uV = 1700000, .uV_step = 100000 },
+};
+
+static int wm8400_ldo_get_voltage_sel(struct regulator_dev *dev)
 {
 	struct wm8400 *wm8400 = rdev_get_drvdata(dev);
 	u16 val;
 
 	val = wm8400_reg_read(wm8400, WM8400_LDO1_CONTROL + rdev_get_id(dev));
-	val &= WM8400_LDO1_VSEL_MASK;
-
-	if (val < 15)
-		return 900000 + (val * 50000);
-	else
-		return 1600000 + ((val - 14) * 100000);
+	return val & WM8400_LDO1_VSEL_MASK;
 }
 
-static int wm8400_ldo_set_voltage(struct regulator_dev *dev,
-				  int min_uV, int max_uV)
+static int wm8400_ldo_set_voltage_sel(struct regulator_dev *dev,
+				      unsigned selector)
 {
 	struct wm8400 *wm8400 = rdev_get_drvdata(dev);
-	u16 val;
-
-	if (min_uV < 900000 || min_uV > 3300000)
-		return -EINVAL;
 
-	if (min_uV < 1700000) {
-		/* Steps of 50mV from 900mV;  */
-		val = (min_uV - 850001) / 50000;
+	return wm8400_set_bits(wm8400, WM8400_LDO1_CONTROL + rdev_get_id(dev),
+			       WM8400_LDO1_VSEL_MASK, selector);
+}
 
-		if ((val * 50000) + 900000 > max_uV)
-			return -EINVAL;
-		BUG_ON((val * 50000) + 900000 < min_uV);
-	} else {
-		/* Steps of 100mV from 1700mV */
-		val = ((min_uV - 1600001) / 100000);
+static int wm8400_batch_begin(struct regulator_dev *dev)
+{
+	struct wm8400 *wm8400 = rdev_get_drvdata(dev);
 
-		if ((val * 100000) + 1700000 > max_uV)
-			return -EINVAL;
-		BUG_ON((val * 100000) + 1700000 < min_uV);
+	wm8400_reg_batch_begin(wm8400);
+	return 0;
+}
 
-		val += 0xf;
-	}
+static int wm8400_batch_commit(struct regulator_dev *dev)
+{
+	struct wm8400 *wm8400 = rdev_get_drvdata(dev);
 
-	return wm8400_set_bits(wm8400, WM8400_LDO1_CONTROL + rdev_get_id(dev),
-			       WM8400_LDO1_VSEL_MASK, val);
+	return wm8400_reg_batch_commit(wm8400);
 }
 
 static struct regulator_ops wm8400_ldo_ops = {
 	.is_enabled = wm8400_ldo_is_enabled,
 	.enable = wm8400_ldo_enable,
 	.disable = wm8400_ldo_disable,
-	.get_voltage = wm8400_ldo_get_voltage,
-	.set_voltage = wm8400_ldo_set_voltage,
+	.get_voltage_sel = wm8400_ldo_get_voltage_sel,
+	.set_voltage_sel = wm8400_ldo_set_voltage_sel,
+	.batch_begin = wm8400_batch_begin,
+	.batch_commit = wm8400_batch_commit,
 };
 
 static int wm8400_dcdc_is_enabled(struct regulator_dev *dev)
@@ -124,36 +120,28 @@ static int wm8400_dcdc_disable(struct regulator_dev *dev)
 			       WM8400_DC1_ENA, 0);
 }
 
-static int wm8400_dcdc_get_voltage(struct regulator_dev *dev)
+static const struct regulator_linear_range wm8400_dcdc_ranges[] = {
+	{ .min_sel = 0, .max_sel = 127, .min_uV = 850000, .uV_step = 25000 },
+};
+
+static int wm8400_dcdc_get_voltage_sel(struct regulator_dev *dev)
 {
 	struct wm8400 *wm8400 = rdev_get_drvdata(dev);
 	u16 val;
 	int offset = (rdev_get_id(dev) - WM8400_DCDC1) * 2;
 
 	val = wm8400_reg_read(wm8400, WM8400_DCDC1_CONTROL_1 + offset);
-	val &= WM8400_DC1_VSEL_MASK;
-
-	return 850000 + (25000 * val);
+	return val & WM8400_DC1_VSEL_MASK;
 }
 
-static int wm8400_dcdc_set_voltage(struct regulator_dev *dev,
-				  int min_uV, int max_uV)
+static int wm8400_dcdc_set_voltage_sel(struct regulator_dev *dev,
+				       unsigned selector)
 {
 	struct wm8400 *wm8400 = rdev_get_drvdata(dev);
-	u16 val;
 	int offset = (rdev_get_id(dev) - WM8400_DCDC1) * 2;
 
-	if (min_uV < 850000)
-		return -EINVAL;
-
-	val = (min_uV - 825001) / 25000;
-
-	if (850000 + (25000 * val) > max_uV)
-		return -EINVAL;
-	BUG_ON(850000 + (25000 * val) < min_uV);
-
 	return wm8400_set_bits(wm8400, WM8400_DCDC1_CONTROL_1 + offset,
-			       WM8400_DC1_VSEL_MASK, val);
+			       WM8400_DC1_VSEL_MASK, selector);
 }
 
 static unsigned int wm8400_dcdc_get_mode(struct regulator_dev *dev)
@@ -237,11 +225,13 @@ static struct regulator_ops wm8400_dcdc_ops = {
 	.is_enabled = wm8400_dcdc_is_enabled,
 	.enable = wm8400_dcdc_enable,
 	.disable = wm8400_dcdc_disable,
-	.get_voltage = wm8400_dcdc_get_voltage,
-	.set_voltage = wm8400_dcdc_set_voltage,
+	.get_voltage_sel = wm8400_dcdc_get_voltage_sel,
+	.set_voltage_sel = wm8400_dcdc_set_voltage_sel,
 	.get_mode = wm8400_dcdc_get_mode,
 	.set_mode = wm8400_dcdc_set_mode,
 	.get_optimum_mode = wm8400_dcdc_get_optimum_mode,
+	.batch_begin = wm8400_batch_begin,
+	.batch_commit = wm8400_batch_commit,
 };
 
 static struct regulator_desc regulators[] = {
@@ -251,6 +241,11 @@ static struct regulator_desc regulators[] = {
 		.ops = &wm8400_ldo_ops,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8400_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8400_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8400_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO2",
@@ -258,6 +253,11 @@ static struct regulator_desc regulators[] = {
 		.ops = &wm8400_ldo_ops,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8400_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8400_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8400_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO3",
@@ -265,6 +265,11 @@ static struct regulator_desc regulators[] = {
 		.ops = &wm8400_ldo_ops,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8400_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8400_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8400_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "LDO4",
@@ -272,6 +277,11 @@ static struct regulator_desc regulators[] = {
 		.ops = &wm8400_ldo_ops,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8400_LDO1_VSEL_MASK + 1,
+		.linear_ranges = wm8400_ldo_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8400_ldo_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "DCDC1",
@@ -279,6 +289,12 @@ static struct regulator_desc regulators[] = {
 		.ops = &wm8400_dcdc_ops,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8400_DC1_VSEL_MASK + 1,
+		.linear_ranges = wm8400_dcdc_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8400_dcdc_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_MODE |
+			       REGULATOR_CACHE_STATUS,
 	},
 	{
 		.name = "DCDC2",
@@ -286,6 +302,12 @@ static struct regulator_desc regulators[] = {
 		.ops = &wm8400_dcdc_ops,
 		.type = REGULATOR_VOLTAGE,
 		.owner = THIS_MODULE,
+		.parent_pmic = 1,
+		.n_voltages = WM8400_DC1_VSEL_MASK + 1,
+		.linear_ranges = wm8400_dcdc_ranges,
+		.n_linear_ranges = ARRAY_SIZE(wm8400_dcdc_ranges),
+		.cache_flags = REGULATOR_CACHE_VOLTAGE | REGULATOR_CACHE_MODE |
+			       REGULATOR_CACHE_STATUS,
 	},
 };
 
@@ -294,7 +316,7 @@ static int __init wm8400_regulator_probe(struct platform_device *pdev)
 	struct regulator_dev *rdev;
 
 	rdev = regulator_register(&regulators[pdev->id], &pdev->dev,
-		pdev->dev.driver_data);
+		pdev->dev.platform_data, pdev->dev.driver_data);
 
 	if (IS_ERR(rdev))
 		return PTR_ERR(rdev);
@@ -363,6 +363,26 @@ void cpufreq_frequency_table_get_attr(struct cpufreq_frequency_table *table,
 void cpufreq_frequency_table_put_attr(unsigned int cpu);
 
 
+/*********************************************************************
+ *                     VOLTAGE SCALING HELPERS                       *
+ *********************************************************************/
+
+struct regulator;
+struct cpufreq_voltage;
+
+struct cpufreq_voltage_table {
+	unsigned int	frequency; /* kHz - in ascending order, the voltage
+				    * range applies up to this frequency */
+	int		min_uV;
+	int		max_uV;
+};
+
+struct cpufreq_voltage *
+cpufreq_voltage_register(const cpumask_t *cpus, struct regulator *supply,
+			 const struct cpufreq_voltage_table *table, int num);
+void cpufreq_voltage_unregister(struct cpufreq_voltage *cv);
+
+
 /*********************************************************************
  *                     UNIFIED DEBUG HELPERS                         *
  *********************************************************************/
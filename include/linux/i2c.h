@@ -34,6 +34,7 @@
 #include <linux/device.h>	/* for struct device */
 #include <linux/sched.h>	/* for completion */
 #include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 extern struct bus_type i2c_bus_type;
 
@@ -62,6 +63,44 @@ extern int i2c_master_recv(struct i2c_client *client, char *buf, int count);
 extern int i2c_transfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
 			int num);
 
+/* Priority classes for asynchronous transfers, highest first.  Queued
+ * transfers in a higher class always go before those in a lower one.
+ */
+enum i2c_prio {
+	I2C_PRIO_HIGH,		/* e.g. interrupt status reads */
+	I2C_PRIO_NORMAL,
+	I2C_PRIO_BULK,		/* e.g. audio CODEC register updates */
+	I2C_PRIO_COUNT,
+};
+
+/**
+ * struct i2c_request - an asynchronous I2C transfer
+ * @msgs: Messages to transfer, as for i2c_transfer()
+ * @num: Number of messages
+ * @prio: Priority class
+ * @complete: Called in process context once the transfer has finished
+ * @context: For use by the submitter
+ * @status: Set before @complete is called: the number of messages
+ *	transferred or a negative errno
+ *
+ * The request and its messages must remain valid until @complete has
+ * been called.
+ */
+struct i2c_request {
+	struct i2c_msg *msgs;
+	int num;
+	enum i2c_prio prio;
+	void (*complete)(struct i2c_request *req);
+	void *context;
+	int status;
+
+	/* private to i2c-core */
+	struct list_head queue;
+};
+
+extern int i2c_transfer_async(struct i2c_adapter *adap,
+			      struct i2c_request *req);
+
 /* This is the very generalized SMBus access routine. You probably do not
    want to use this, though; one of the functions below may be much easier,
    and probably just as fast.
@@ -369,6 +408,13 @@ struct i2c_adapter {
 	struct list_head clients;	/* DEPRECATED */
 	char name[48];
 	struct completion dev_released;
+
+	/* asynchronous transfers, see i2c_transfer_async() */
+	spinlock_t queue_lock;
+	struct list_head queue[I2C_PRIO_COUNT];
+	struct work_struct queue_work;
+	int queue_busy;
+	int queue_stopped;
 };
 #define to_i2c_adapter(d) container_of(d, struct i2c_adapter, dev)
 
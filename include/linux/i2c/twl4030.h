@@ -81,6 +81,23 @@ int twl4030_i2c_read_u8(u8 mod_no, u8 *val, u8 reg);
 int twl4030_i2c_write(u8 mod_no, u8 *value, u8 reg, u8 num_bytes);
 int twl4030_i2c_read(u8 mod_no, u8 *value, u8 reg, u8 num_bytes);
 
+/*
+ * Read and write register blocks in several modules at once.  All the
+ * blocks on one i2c slave go out as a single transfer, in array order.
+ * Write buffers follow the twl4030_i2c_write() convention.
+ */
+struct twl4030_xfer {
+	u8	mod_no;
+	u8	reg;
+	u8	num_bytes;
+	bool	write;
+	u8	*value;
+};
+
+#define TWL4030_XFER_MAX		12
+
+int twl4030_i2c_xfer(struct twl4030_xfer *xfer, unsigned num);
+
 /*----------------------------------------------------------------------*/
 
 /*
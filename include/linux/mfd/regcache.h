@@ -0,0 +1,81 @@
+/*
+ * regcache.h  --  Register cache for MFD cores
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+
+#ifndef __LINUX_MFD_REGCACHE_H
+#define __LINUX_MFD_REGCACHE_H
+
+#include <linux/types.h>
+
+struct regcache;
+
+/*
+ * Cache backends.  The flat cache is an array covering every register
+ * and suits small, densely populated maps.  The rbtree cache only holds
+ * blocks of registers which have been stored and suits large maps with
+ * few registers in use.
+ */
+enum regcache_type {
+	REGCACHE_FLAT,
+	REGCACHE_RBTREE,
+};
+
+/* A range of registers, inclusive */
+struct regcache_range {
+	unsigned int start;
+	unsigned int end;
+};
+
+/**
+ * struct regcache_config - Description of a register map
+ *
+ * @type:             Cache backend to use.
+ * @max_register:     Highest register in the map.
+ * @defaults:         Values for registers never stored, if not zero.
+ *                    Must cover every register up to max_register.
+ * @volatile_ranges:  Registers whose value can change without being
+ *                    written.  These are never written back by a sync.
+ * @num_volatile_ranges: Number of entries in volatile_ranges.
+ * @volatile_reg:     Optional test for volatile registers, used as well
+ *                    as volatile_ranges.
+ * @writable_reg:     Optional test for registers which may be written
+ *                    back by a sync at the moment, e.g. not locked.
+ * @write:            Write count registers to the device starting at
+ *                    reg.  The values are host endian and the buffer
+ *                    may be modified.
+ * @max_block:        Most registers written in a single transfer by a
+ *                    sync, 0 for no limit.
+ * @data:             Passed to the callbacks.
+ */
+struct regcache_config {
+	enum regcache_type type;
+	unsigned int max_register;
+	const u16 *defaults;
+
+	const struct regcache_range *volatile_ranges;
+	int num_volatile_ranges;
+	int (*volatile_reg)(void *data, unsigned int reg);
+	int (*writable_reg)(void *data, unsigned int reg);
+
+	int (*write)(void *data, unsigned int reg, int count, u16 *src);
+	int max_block;
+
+	void *data;
+};
+
+struct regcache *regcache_init(const struct regcache_config *config);
+void regcache_exit(struct regcache *rc);
+
+u16 regcache_read(struct regcache *rc, unsigned int reg);
+int regcache_write(struct regcache *rc, unsigned int reg, u16 val);
+int regcache_volatile(struct regcache *rc, unsigned int reg);
+
+void regcache_set_dirty(struct regcache *rc, unsigned int reg, int dirty);
+void regcache_mark_dirty(struct regcache *rc);
+int regcache_sync(struct regcache *rc);
+
+#endif
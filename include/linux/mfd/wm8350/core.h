@@ -551,6 +551,7 @@ extern const u16 wm8350_mode2_defaults[];
 extern const u16 wm8350_mode3_defaults[];
 
 struct wm8350;
+struct regcache;
 
 struct wm8350_irq {
 	void (*handler) (struct wm8350 *, int, void *);
@@ -570,7 +571,12 @@ struct wm8350 {
 	int (*read_dev)(struct wm8350 *wm8350, char reg, int size, void *dest);
 	int (*write_dev)(struct wm8350 *wm8350, char reg, int size,
 			 void *src);
-	u16 *reg_cache;
+	struct regcache *reg_cache;
+
+	/* Batched writes, see wm8350_reg_batch_begin() */
+	struct mutex batch_mutex;
+	struct task_struct *batch_owner;
+	int batch_depth;
 
 	/* Interrupt handling */
 	struct work_struct irq_work;
@@ -616,6 +622,8 @@ int wm8350_reg_lock(struct wm8350 *wm8350);
 int wm8350_reg_unlock(struct wm8350 *wm8350);
 int wm8350_block_read(struct wm8350 *wm8350, int reg, int size, u16 *dest);
 int wm8350_block_write(struct wm8350 *wm8350, int reg, int size, u16 *src);
+void wm8350_reg_batch_begin(struct wm8350 *wm8350);
+int wm8350_reg_batch_commit(struct wm8350 *wm8350);
 
 /*
  * WM8350 internal interrupts
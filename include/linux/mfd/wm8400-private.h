@@ -27,6 +27,8 @@
 
 #define WM8400_REGISTER_COUNT 0x55
 
+struct regcache;
+
 struct wm8400 {
 	struct device *dev;
 
@@ -36,7 +38,12 @@ struct wm8400 {
 	struct mutex io_lock;
 	void *io_data;
 
-	u16 reg_cache[WM8400_REGISTER_COUNT];
+	struct regcache *reg_cache;
+
+	/* Batched writes, see wm8400_reg_batch_begin() */
+	struct mutex batch_lock;
+	struct task_struct *batch_owner;
+	int batch_depth;
 
 	struct platform_device regulators[6];
 };
@@ -932,5 +939,7 @@ struct wm8400 {
 u16 wm8400_reg_read(struct wm8400 *wm8400, u8 reg);
 int wm8400_block_read(struct wm8400 *wm8400, u8 reg, int count, u16 *data);
 int wm8400_set_bits(struct wm8400 *wm8400, u8 reg, u16 mask, u16 val);
+void wm8400_reg_batch_begin(struct wm8400 *wm8400);
+int wm8400_reg_batch_commit(struct wm8400 *wm8400);
 
 #endif
@@ -118,6 +118,25 @@ struct regulator_bulk_data {
 	struct regulator *consumer;
 };
 
+/**
+ * struct regulator_change - A change for regulator_apply_state().
+ *
+ * @consumer The regulator consumer to change.
+ * @min_uV   Minimum required voltage in uV.
+ * @max_uV   Maximum acceptable voltage in uV, or zero to leave the
+ *           voltage request unchanged.
+ * @mode     New operating mode, or zero to leave the mode unchanged.
+ * @enable   Positive to enable the consumer, negative to disable it or
+ *           zero to leave it as it is.
+ */
+struct regulator_change {
+	struct regulator *consumer;
+	int min_uV;
+	int max_uV;
+	unsigned int mode;
+	int enable;
+};
+
 #if defined(CONFIG_REGULATOR)
 
 /* regulator get and put */
@@ -127,10 +146,18 @@ void regulator_put(struct regulator *regulator);
 
 /* regulator output control and status */
 int regulator_enable(struct regulator *regulator);
+int regulator_enable_async(struct regulator *regulator,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data);
 int regulator_disable(struct regulator *regulator);
 int regulator_force_disable(struct regulator *regulator);
 int regulator_is_enabled(struct regulator *regulator);
 
+/* output control from atomic context, for regulators that never sleep */
+int regulator_enable_atomic(struct regulator *regulator);
+int regulator_disable_atomic(struct regulator *regulator);
+int regulator_is_enabled_atomic(struct regulator *regulator);
+
 int regulator_bulk_get(struct device *dev, int num_consumers,
 		       struct regulator_bulk_data *consumers);
 int regulator_bulk_enable(int num_consumers,
@@ -141,7 +168,13 @@ void regulator_bulk_free(int num_consumers,
 			 struct regulator_bulk_data *consumers);
 
 int regulator_set_voltage(struct regulator *regulator, int min_uV, int max_uV);
+int regulator_set_voltage_async(struct regulator *regulator,
+	int min_uV, int max_uV,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data);
 int regulator_get_voltage(struct regulator *regulator);
+int regulator_count_voltages(struct regulator *regulator);
+int regulator_list_voltage(struct regulator *regulator, unsigned selector);
 int regulator_set_current_limit(struct regulator *regulator,
 			       int min_uA, int max_uA);
 int regulator_get_current_limit(struct regulator *regulator);
@@ -150,6 +183,8 @@ int regulator_set_mode(struct regulator *regulator, unsigned int mode);
 unsigned int regulator_get_mode(struct regulator *regulator);
 int regulator_set_optimum_mode(struct regulator *regulator, int load_uA);
 
+int regulator_apply_state(int num_changes, struct regulator_change *changes);
+
 /* regulator notifier block */
 int regulator_register_notifier(struct regulator *regulator,
 			      struct notifier_block *nb);
@@ -184,6 +219,14 @@ static inline int regulator_enable(struct regulator *regulator)
 	return 0;
 }
 
+static inline int regulator_enable_async(struct regulator *regulator,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data)
+{
+	complete(regulator, 0, data);
+	return 0;
+}
+
 static inline int regulator_disable(struct regulator *regulator)
 {
 	return 0;
@@ -194,6 +237,21 @@ static inline int regulator_is_enabled(struct regulator *regulator)
 	return 1;
 }
 
+static inline int regulator_enable_atomic(struct regulator *regulator)
+{
+	return 0;
+}
+
+static inline int regulator_disable_atomic(struct regulator *regulator)
+{
+	return 0;
+}
+
+static inline int regulator_is_enabled_atomic(struct regulator *regulator)
+{
+	return 1;
+}
+
 static inline int regulator_bulk_get(struct device *dev,
 				     int num_consumers,
 				     struct regulator_bulk_data *consumers)
@@ -224,11 +282,31 @@ static inline int regulator_set_voltage(struct regulator *regulator,
 	return 0;
 }
 
+static inline int regulator_set_voltage_async(struct regulator *regulator,
+	int min_uV, int max_uV,
+	void (*complete)(struct regulator *regulator, int ret, void *data),
+	void *data)
+{
+	complete(regulator, 0, data);
+	return 0;
+}
+
 static inline int regulator_get_voltage(struct regulator *regulator)
 {
 	return 0;
 }
 
+static inline int regulator_count_voltages(struct regulator *regulator)
+{
+	return 0;
+}
+
+static inline int regulator_list_voltage(struct regulator *regulator,
+					 unsigned selector)
+{
+	return 0;
+}
+
 static inline int regulator_set_current_limit(struct regulator *regulator,
 					     int min_uA, int max_uA)
 {
@@ -257,6 +335,12 @@ static inline int regulator_set_optimum_mode(struct regulator *regulator,
 	return REGULATOR_MODE_NORMAL;
 }
 
+static inline int regulator_apply_state(int num_changes,
+					struct regulator_change *changes)
+{
+	return 0;
+}
+
 static inline int regulator_register_notifier(struct regulator *regulator,
 			      struct notifier_block *nb)
 {
@@ -32,6 +32,21 @@ struct regulator_ops {
 	int (*set_voltage) (struct regulator_dev *, int min_uV, int max_uV);
 	int (*get_voltage) (struct regulator_dev *);
 
+	/* get/set regulator voltage as a selector from 0 to n_voltages - 1,
+	 * the core maps voltage ranges onto selectors for the driver */
+	int (*set_voltage_sel) (struct regulator_dev *, unsigned selector);
+	int (*get_voltage_sel) (struct regulator_dev *);
+
+	/* voltage in uV for a selector, or zero if it is not supported.  Only
+	 * needed if regulator_desc doesn't describe the voltages */
+	int (*list_voltage) (struct regulator_dev *, unsigned selector);
+
+	/* time in microseconds taken for the output to settle after a
+	 * voltage change, if it varies in a way regulator_desc can't
+	 * describe */
+	int (*set_voltage_time) (struct regulator_dev *,
+				 int old_uV, int new_uV);
+
 	/* get/set regulator current  */
 	int (*set_current_limit) (struct regulator_dev *,
 				 int min_uA, int max_uA);
@@ -42,6 +57,10 @@ struct regulator_ops {
 	int (*disable) (struct regulator_dev *);
 	int (*is_enabled) (struct regulator_dev *);
 
+	/* time in microseconds taken for the output to settle after enable,
+	 * if it varies in a way regulator_desc can't describe */
+	int (*enable_time) (struct regulator_dev *);
+
 	/* get/set regulator operating mode (defined in regulator.h) */
 	int (*set_mode) (struct regulator_dev *, unsigned int mode);
 	unsigned int (*get_mode) (struct regulator_dev *);
@@ -50,6 +69,13 @@ struct regulator_ops {
 	unsigned int (*get_optimum_mode) (struct regulator_dev *, int input_uV,
 					  int output_uV, int load_uA);
 
+	/* defer the register writes of the operations above until
+	 * batch_commit(), which should write them out in as few bus
+	 * transfers as possible.  Batches may nest and cover every
+	 * regulator on the same PMIC. */
+	int (*batch_begin) (struct regulator_dev *);
+	int (*batch_commit) (struct regulator_dev *);
+
 	/* the operations below are for configuration of regulator state when
 	 * its parent PMIC enters a global STANDBY/HIBERNATE state */
 
@@ -72,6 +98,40 @@ enum regulator_type {
 	REGULATOR_CURRENT,
 };
 
+/*
+ * Regulator state cache flags. These flags allow the core to keep a copy of
+ * the corresponding hardware state in memory and answer reads from it
+ * rather than calling into the driver.  They can be OR'ed together.
+ *
+ * Drivers should only set a flag when the hardware value can not change
+ * without the core knowing about it - i.e. it is only ever changed through
+ * the regulator_ops or reported with regulator_notifier_call_chain().
+ *
+ * VOLTAGE:  Output voltage returned by get_voltage().
+ * CURRENT:  Current limit returned by get_current_limit().
+ * MODE:     Operating mode returned by get_mode().
+ * STATUS:   Enable state returned by is_enabled().
+ */
+#define REGULATOR_CACHE_VOLTAGE		0x1
+#define REGULATOR_CACHE_CURRENT		0x2
+#define REGULATOR_CACHE_MODE		0x4
+#define REGULATOR_CACHE_STATUS		0x8
+
+/**
+ * struct regulator_linear_range - evenly spaced voltage selectors
+ *
+ * @min_sel: First selector in the range
+ * @max_sel: Last selector in the range
+ * @min_uV: Voltage of min_sel
+ * @uV_step: Voltage step between selectors
+ */
+struct regulator_linear_range {
+	unsigned int min_sel;
+	unsigned int max_sel;
+	int min_uV;
+	int uV_step;
+};
+
 /**
  * struct regulator_desc - Regulator descriptor
  *
@@ -83,15 +143,39 @@ struct regulator_desc {
 	int irq;
 	enum regulator_type type;
 	struct module *owner;
+	unsigned int cache_flags; /* REGULATOR_CACHE_* state we may cache */
+
+	/* output settling, the core waits for these after changes */
+	unsigned int enable_time; /* us from enable to stable output */
+	unsigned int ramp_delay; /* voltage slew rate in uV/us */
+
+	/* voltages for set_voltage_sel(), described by list_voltage() or
+	 * else by linear_ranges or a volt_table indexed by selector */
+	unsigned int n_voltages;
+	const struct regulator_linear_range *linear_ranges;
+	int n_linear_ranges;
+	const int *volt_table;
+
+	/* set if enable(), disable() and is_enabled() never sleep, allowing
+	 * consumers to use regulator_enable_atomic() and friends */
+	int atomic;
+
+	/* set if the device registering the regulator is a child of the
+	 * PMIC, so regulators sharing its I/O are grouped by the parent
+	 * rather than by the registering device */
+	int parent_pmic;
 };
 
 struct regulator_dev *regulator_register(struct regulator_desc *regulator_desc,
-	struct device *dev, void *driver_data);
+	struct device *dev, struct regulator_init_data *init_data,
+	void *driver_data);
 void regulator_unregister(struct regulator_dev *rdev);
 
 int regulator_notifier_call_chain(struct regulator_dev *rdev,
 				  unsigned long event, void *data);
 
+int regulator_map_voltage(struct regulator_dev *rdev, int min_uV, int max_uV);
+
 void *rdev_get_drvdata(struct regulator_dev *rdev);
 struct device *rdev_get_dev(struct regulator_dev *rdev);
 int rdev_get_id(struct regulator_dev *rdev);
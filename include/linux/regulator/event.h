@@ -0,0 +1,52 @@
+/*
+ * event.h -- Regulator event device records.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ *
+ * Records read from /dev/regulator_events.  Each read() returns as many
+ * whole records as are waiting and fit in the buffer, oldest first.
+ */
+
+#ifndef __LINUX_REGULATOR_EVENT_H_
+#define __LINUX_REGULATOR_EVENT_H_
+
+#include <linux/types.h>
+
+/*
+ * Record types and the meaning of value for each.
+ *
+ * EVENT    Notifier event, value is the REGULATOR_EVENT_* bits.
+ * ENABLE   Output turned on, value is unused.
+ * DISABLE  Output turned off, value is unused.
+ * VOLTAGE  Voltage set, value is the voltage in uV or the lowest voltage
+ *          requested if the driver can not say exactly.
+ * MODE     Operating mode set, value is the REGULATOR_MODE_* constant.
+ */
+#define REGULATOR_RECORD_EVENT		0
+#define REGULATOR_RECORD_ENABLE		1
+#define REGULATOR_RECORD_DISABLE	2
+#define REGULATOR_RECORD_VOLTAGE	3
+#define REGULATOR_RECORD_MODE		4
+
+/**
+ * struct regulator_event_record - one regulator event or state change
+ *
+ * @timestamp: CLOCK_MONOTONIC time of the record in ns.
+ * @regulator: N from the regulator.N class device of the regulator.
+ * @type: One of the REGULATOR_RECORD_* types.
+ * @value: Depends on type, see above.
+ * @lost: Number of records dropped before this one because the reader did
+ *        not keep up.
+ */
+struct regulator_event_record {
+	__u64 timestamp;
+	__u32 regulator;
+	__u16 type;
+	__u16 lost;
+	__s32 value;
+	__u32 reserved;
+};
+
+#endif
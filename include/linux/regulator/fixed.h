@@ -14,9 +14,29 @@
 #ifndef __REGULATOR_FIXED_H
 #define __REGULATOR_FIXED_H
 
+struct regulator_init_data;
+
+/**
+ * struct fixed_voltage_config - fixed voltage regulator configuration
+ *
+ * Platform data for the reg-fixed-voltage device.
+ *
+ * @supply_name: Name of the regulator supply
+ * @microvolts: Output voltage of regulator
+ * @gpio: GPIO to use for enable control, only used if has_gpio is set
+ * @has_gpio: Set if gpio controls the output, otherwise it is always on
+ * @enable_high: Polarity of enable GPIO, 1 = active high
+ * @enabled_at_boot: Whether the regulator is enabled at boot
+ * @init_data: Constraints and consumer supplies for the regulator
+ */
 struct fixed_voltage_config {
 	const char *supply_name;
 	int microvolts;
+	int gpio;
+	unsigned has_gpio:1;
+	unsigned enable_high:1;
+	unsigned enabled_at_boot:1;
+	struct regulator_init_data *init_data;
 };
 
 #endif
@@ -77,6 +77,17 @@ struct regulation_constraints {
 	/* regulator input voltage - only if supply is another regulator */
 	int input_uV;
 
+	/* DRMS policy - defer changes to more efficient modes by delay_ms,
+	 * making them only once the load has been hysteresis_uA below the
+	 * switch point and at least residency_ms since the last change */
+	unsigned int drms_delay_ms;
+	unsigned int drms_hysteresis_uA;
+	unsigned int drms_residency_ms;
+
+	/* keep the output on for off_delay_ms after the last consumer
+	 * disables it, saving the enable and ramp if it is wanted again */
+	unsigned int off_delay_ms;
+
 	/* regulator suspend states for global PMIC STANDBY/HIBERNATE */
 	struct regulator_state state_disk;
 	struct regulator_state state_mem;
@@ -222,6 +222,7 @@ int snd_soc_dapm_new_controls(struct snd_soc_codec *codec,
 
 /* dapm path setup */
 int snd_soc_dapm_new_widgets(struct snd_soc_codec *codec);
+void snd_soc_dapm_connect_path(struct snd_soc_dapm_path *path, int connect);
 void snd_soc_dapm_free(struct snd_soc_device *socdev);
 int snd_soc_dapm_add_routes(struct snd_soc_codec *codec,
 			    const struct snd_soc_dapm_route *route, int num);
@@ -318,6 +319,11 @@ struct snd_soc_dapm_widget {
 	unsigned char muted:1;			/* muted for pop reduction */
 	unsigned char suspend:1;		/* was active before suspend */
 	unsigned char pmdown:1;			/* waiting for timeout */
+	unsigned char dirty:1;			/* power needs re-evaluating */
+
+	/* cached endpoint connectivity, -1 until walked */
+	int inputs;
+	int outputs;
 
 	/* external events */
 	unsigned short event_flags;		/* flags to specify event types */
@@ -0,0 +1,29 @@
+#ifndef _TRACE_REGULATOR_H
+#define _TRACE_REGULATOR_H
+
+#include <linux/tracepoint.h>
+
+/*
+ * Operations traced and accounted by the regulator core.  The driver
+ * operations are traced around the call into the regulator driver,
+ * SET_OPTIMUM_MODE is only accounted against consumers.
+ */
+enum regulator_op {
+	REGULATOR_OP_ENABLE,
+	REGULATOR_OP_DISABLE,
+	REGULATOR_OP_SET_VOLTAGE,
+	REGULATOR_OP_GET_VOLTAGE,
+	REGULATOR_OP_SET_MODE,
+	REGULATOR_OP_SET_OPTIMUM_MODE,
+	REGULATOR_OP_COUNT,
+};
+
+DECLARE_TRACE(regulator_op_start,
+	TPPROTO(const char *name, int op),
+		TPARGS(name, op));
+
+DECLARE_TRACE(regulator_op_end,
+	TPPROTO(const char *name, int op, int ret, s64 us),
+		TPARGS(name, op, ret, us));
+
+#endif
@@ -197,10 +197,10 @@ static int snd_soc_dapm_put_volsw_aic3x(struct snd_kcontrol *kcontrol,
 			found = 1;
 			if (val)
 				/* new connection */
-				path->connect = invert ? 0 : 1;
+				snd_soc_dapm_connect_path(path, invert ? 0 : 1);
 			else
 				/* old connection must be powered down */
-				path->connect = invert ? 1 : 0;
+				snd_soc_dapm_connect_path(path, invert ? 1 : 0);
 			break;
 		}
 
@@ -16,6 +16,7 @@
 #include <linux/delay.h>
 #include <linux/pm.h>
 #include <linux/platform_device.h>
+#include <linux/mfd/regcache.h>
 #include <linux/mfd/wm8350/audio.h>
 #include <linux/mfd/wm8350/core.h>
 #include <linux/regulator/consumer.h>
@@ -62,7 +63,7 @@ static unsigned int wm8350_codec_cache_read(struct snd_soc_codec *codec,
 					    unsigned int reg)
 {
 	struct wm8350 *wm8350 = codec->control_data;
-	return wm8350->reg_cache[reg];
+	return regcache_read(wm8350->reg_cache, reg);
 }
 
 static unsigned int wm8350_codec_read(struct snd_soc_codec *codec,
@@ -376,24 +376,53 @@ static int dapm_new_pga(struct snd_soc_codec *codec,
 	return ret;
 }
 
-/* reset 'walked' bit for each dapm path */
-static inline void dapm_clear_walk(struct snd_soc_codec *codec)
+/*
+ * Reset the 'walked' bit of each dapm path walked from a widget.  Only
+ * the paths a walk marked are visited, rather than every path in the
+ * codec.
+ */
+static void dapm_clear_walk_output(struct snd_soc_dapm_widget *widget)
 {
-	struct snd_soc_dapm_path *p;
+	struct snd_soc_dapm_path *path;
 
-	list_for_each_entry(p, &codec->dapm_paths, list)
-		p->walked = 0;
+	list_for_each_entry(path, &widget->sinks, list_source) {
+		if (!path->walked)
+			continue;
+		path->walked = 0;
+		if (path->sink)
+			dapm_clear_walk_output(path->sink);
+	}
+}
+
+static void dapm_clear_walk_input(struct snd_soc_dapm_widget *widget)
+{
+	struct snd_soc_dapm_path *path;
+
+	list_for_each_entry(path, &widget->sources, list_sink) {
+		if (!path->walked)
+			continue;
+		path->walked = 0;
+		if (path->source)
+			dapm_clear_walk_input(path->source);
+	}
 }
 
 /*
  * Recursively check for a completed path to an active or physically connected
  * output widget. Returns number of complete paths.
+ *
+ * A widget whose connectivity is already cached is not walked again.  Only
+ * top level walks store the result since a nested walk can stop short at
+ * paths marked by the caller.
  */
 static int is_connected_output_ep(struct snd_soc_dapm_widget *widget)
 {
 	struct snd_soc_dapm_path *path;
 	int con = 0;
 
+	if (widget->outputs >= 0)
+		return widget->outputs;
+
 	if (widget->id == snd_soc_dapm_adc && widget->active)
 		return 1;
 
@@ -430,6 +459,9 @@ static int is_connected_input_ep(struct snd_soc_dapm_widget *widget)
 	struct snd_soc_dapm_path *path;
 	int con = 0;
 
+	if (widget->inputs >= 0)
+		return widget->inputs;
+
 	/* active stream ? */
 	if (widget->id == snd_soc_dapm_dac && widget->active)
 		return 1;
@@ -461,6 +493,109 @@ static int is_connected_input_ep(struct snd_soc_dapm_widget *widget)
 	return con;
 }
 
+/* cached output connectivity of a widget, walking the graph if unknown */
+static int dapm_widget_outputs(struct snd_soc_dapm_widget *widget)
+{
+	if (widget->outputs < 0) {
+		widget->outputs = is_connected_output_ep(widget);
+		dapm_clear_walk_output(widget);
+	}
+	return widget->outputs;
+}
+
+/* cached input connectivity of a widget, walking the graph if unknown */
+static int dapm_widget_inputs(struct snd_soc_dapm_widget *widget)
+{
+	if (widget->inputs < 0) {
+		widget->inputs = is_connected_input_ep(widget);
+		dapm_clear_walk_input(widget);
+	}
+	return widget->inputs;
+}
+
+/*
+ * Forget the output connectivity of a widget and of every widget feeding
+ * it, whether or not the paths are currently connected, and mark them
+ * for power re-evaluation.  Widgets which can't reach the change keep
+ * their cached state.
+ */
+static void dapm_invalidate_outputs(struct snd_soc_dapm_widget *widget)
+{
+	struct snd_soc_dapm_path *path;
+
+	widget->outputs = -1;
+	widget->dirty = 1;
+
+	list_for_each_entry(path, &widget->sources, list_sink) {
+		if (path->walked)
+			continue;
+
+		path->walked = 1;
+		if (path->source)
+			dapm_invalidate_outputs(path->source);
+	}
+}
+
+/* as above for the input connectivity of the widgets a widget feeds */
+static void dapm_invalidate_inputs(struct snd_soc_dapm_widget *widget)
+{
+	struct snd_soc_dapm_path *path;
+
+	widget->inputs = -1;
+	widget->dirty = 1;
+
+	list_for_each_entry(path, &widget->sinks, list_source) {
+		if (path->walked)
+			continue;
+
+		path->walked = 1;
+		if (path->sink)
+			dapm_invalidate_inputs(path->sink);
+	}
+}
+
+/* a widget has become, or stopped being, an endpoint */
+static void dapm_invalidate_widget(struct snd_soc_dapm_widget *widget)
+{
+	dapm_invalidate_outputs(widget);
+	dapm_clear_walk_input(widget);
+	dapm_invalidate_inputs(widget);
+	dapm_clear_walk_output(widget);
+}
+
+/* a path has been connected or disconnected */
+static void dapm_invalidate_path(struct snd_soc_dapm_path *path)
+{
+	if (path->source) {
+		dapm_invalidate_outputs(path->source);
+		dapm_clear_walk_input(path->source);
+	}
+	if (path->sink) {
+		dapm_invalidate_inputs(path->sink);
+		dapm_clear_walk_output(path->sink);
+	}
+}
+
+/**
+ * snd_soc_dapm_connect_path - connect or disconnect a dapm path
+ * @path: path whose state has changed
+ * @connect: new state of the path
+ *
+ * Codec drivers updating path state from their own controls must use this
+ * rather than setting path->connect so that DAPM re-evaluates the widgets
+ * the path affects.  snd_soc_dapm_sync() then applies the change.
+ */
+void snd_soc_dapm_connect_path(struct snd_soc_dapm_path *path, int connect)
+{
+	connect = connect ? 1 : 0;
+	if (path->connect == connect)
+		return;
+
+	path->connect = connect;
+	dapm_invalidate_path(path);
+}
+EXPORT_SYMBOL_GPL(snd_soc_dapm_connect_path);
+
 /*
  * Handler for generic register modifier widget.
  */
@@ -482,13 +617,16 @@ int dapm_reg_event(struct snd_soc_dapm_widget *w,
 EXPORT_SYMBOL_GPL(dapm_reg_event);
 
 /*
- * Scan each dapm widget for complete audio path.
+ * Scan each dirty dapm widget for complete audio path.
  * A complete path is a route that has valid endpoints i.e.:-
  *
  *  o DAC to output pin.
  *  o Input Pin to ADC.
  *  o Input pin to Output pin (bypass, sidetone)
  *  o DAC to ADC (loopback).
+ *
+ * Widgets are marked dirty when a change could affect their connectivity,
+ * anything else keeps its power state and is skipped.
  */
 static int dapm_power_widgets(struct snd_soc_codec *codec, int event)
 {
@@ -512,13 +650,17 @@ static int dapm_power_widgets(struct snd_soc_codec *codec, int event)
 				continue;
 
 			/* vmid - no action */
-			if (w->id == snd_soc_dapm_vmid)
+			if (w->id == snd_soc_dapm_vmid) {
+				w->dirty = 0;
 				continue;
+			}
 
 			/* active ADC */
 			if (w->id == snd_soc_dapm_adc && w->active) {
-				in = is_connected_input_ep(w);
-				dapm_clear_walk(w->codec);
+				if (!w->dirty)
+					continue;
+				w->dirty = 0;
+				in = dapm_widget_inputs(w);
 				w->power = (in != 0) ? 1 : 0;
 				dapm_update_bits(w);
 				continue;
@@ -526,8 +668,10 @@ static int dapm_power_widgets(struct snd_soc_codec *codec, int event)
 
 			/* active DAC */
 			if (w->id == snd_soc_dapm_dac && w->active) {
-				out = is_connected_output_ep(w);
-				dapm_clear_walk(w->codec);
+				if (!w->dirty)
+					continue;
+				w->dirty = 0;
+				out = dapm_widget_outputs(w);
 				w->power = (out != 0) ? 1 : 0;
 				dapm_update_bits(w);
 				continue;
@@ -570,10 +714,11 @@ static int dapm_power_widgets(struct snd_soc_codec *codec, int event)
 			}
 
 			/* all other widgets */
-			in = is_connected_input_ep(w);
-			dapm_clear_walk(w->codec);
-			out = is_connected_output_ep(w);
-			dapm_clear_walk(w->codec);
+			if (!w->dirty)
+				continue;
+			w->dirty = 0;
+			in = dapm_widget_inputs(w);
+			out = dapm_widget_outputs(w);
 			power = (out != 0 && in != 0) ? 1 : 0;
 			power_change = (w->power == power) ? 0: 1;
 			w->power = power;
@@ -666,10 +811,8 @@ static void dbg_dump_dapm(struct snd_soc_codec* codec, const char *action)
 		case snd_soc_dapm_pga:
 		case snd_soc_dapm_mixer:
 			if (w->name) {
-				in = is_connected_input_ep(w);
-				dapm_clear_walk(w->codec);
-				out = is_connected_output_ep(w);
-				dapm_clear_walk(w->codec);
+				in = dapm_widget_inputs(w);
+				out = dapm_widget_outputs(w);
 				printk("%s: %s  in %d out %d\n", w->name,
 					w->power ? "On":"Off",in, out);
 
@@ -715,9 +858,11 @@ static int dapm_mux_update_power(struct snd_soc_dapm_widget *widget,
 		found = 1;
 		/* we now need to match the string in the enum to the path */
 		if (!(strcmp(path->name, e->texts[mux])))
-			path->connect = 1; /* new connection */
+			/* new connection */
+			snd_soc_dapm_connect_path(path, 1);
 		else
-			path->connect = 0; /* old connection must be powered down */
+			/* old connection must be powered down */
+			snd_soc_dapm_connect_path(path, 0);
 	}
 
 	if (found) {
@@ -752,10 +897,10 @@ static int dapm_mixer_update_power(struct snd_soc_dapm_widget *widget,
 		found = 1;
 		if (val)
 			/* new connection */
-			path->connect = invert ? 0:1;
+			snd_soc_dapm_connect_path(path, invert ? 0:1);
 		else
 			/* old connection must be powered down */
-			path->connect = invert ? 1:0;
+			snd_soc_dapm_connect_path(path, invert ? 1:0);
 		break;
 	}
 
@@ -860,7 +1005,10 @@ static int snd_soc_dapm_set_pin(struct snd_soc_codec *codec,
 	list_for_each_entry(w, &codec->dapm_widgets, list) {
 		if (!strcmp(w->name, pin)) {
 			pr_debug("dapm: %s: pin %s\n", codec->name, pin);
-			w->connected = status;
+			if (w->connected != status) {
+				w->connected = status;
+				dapm_invalidate_widget(w);
+			}
 			return 0;
 		}
 	}
@@ -873,8 +1021,8 @@ static int snd_soc_dapm_set_pin(struct snd_soc_codec *codec,
  * snd_soc_dapm_sync - scan and power dapm paths
  * @codec: audio codec
  *
- * Walks all dapm audio paths and powers widgets according to their
- * stream or path usage.
+ * Walks the dapm audio paths affected by changes since the last sync and
+ * powers widgets according to their stream or path usage.
  *
  * Returns 0 for success.
  */
@@ -940,6 +1088,7 @@ static int snd_soc_dapm_add_route(struct snd_soc_codec *codec,
 		list_add(&path->list_sink, &wsink->sources);
 		list_add(&path->list_source, &wsource->sinks);
 		path->connect = 1;
+		dapm_invalidate_path(path);
 		return 0;
 	}
 
@@ -958,6 +1107,7 @@ static int snd_soc_dapm_add_route(struct snd_soc_codec *codec,
 		list_add(&path->list_sink, &wsink->sources);
 		list_add(&path->list_source, &wsource->sinks);
 		path->connect = 1;
+		dapm_invalidate_path(path);
 		return 0;
 	case snd_soc_dapm_mux:
 		ret = dapm_connect_mux(codec, wsource, wsink, path, control,
@@ -979,8 +1129,10 @@ static int snd_soc_dapm_add_route(struct snd_soc_codec *codec,
 		list_add(&path->list_sink, &wsink->sources);
 		list_add(&path->list_source, &wsource->sinks);
 		path->connect = 0;
+		dapm_invalidate_path(path);
 		return 0;
 	}
+	dapm_invalidate_path(path);
 	return 0;
 
 err:
@@ -1296,6 +1448,11 @@ int snd_soc_dapm_new_control(struct snd_soc_codec *codec,
 	INIT_LIST_HEAD(&w->list);
 	list_add(&w->list, &codec->dapm_widgets);
 
+	/* nothing is known about the connectivity of a new widget */
+	w->inputs = -1;
+	w->outputs = -1;
+	w->dirty = 1;
+
 	/* machine layer set ups unconnected pins and insertions */
 	w->connected = 1;
 	return 0;
@@ -1360,6 +1517,8 @@ int snd_soc_dapm_stream_event(struct snd_soc_codec *codec,
 		pr_debug("widget %s\n %s stream %s event %d\n",
 			 w->name, w->sname, stream, event);
 		if (strstr(w->sname, stream)) {
+			int active = w->active;
+
 			switch(event) {
 			case SND_SOC_DAPM_STREAM_START:
 				w->active = 1;
@@ -1383,6 +1542,9 @@ int snd_soc_dapm_stream_event(struct snd_soc_codec *codec,
 			case SND_SOC_DAPM_STREAM_PAUSE_RELEASE:
 				break;
 			}
+
+			if (w->active != active)
+				dapm_invalidate_widget(w);
 		}
 	}
 	mutex_unlock(&codec->mutex);